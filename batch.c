@@ -0,0 +1,313 @@
+/*
+ * Description: Batch mode. Every line of a job file holds the options and
+ *              program of one run ("prog.txt -m mem.img -n 100000"), blank
+ *              lines and lines starting with '#' are skipped. Programs are
+ *              loaded once and shared read-only between the jobs using them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "parser.h"
+#include "program.h"
+#include "image.h"
+#include "trace.h"
+#include "options.h"
+#include "batch.h"
+
+#define BATCH_MAX_ARGS 32
+
+typedef struct BatchJob
+{
+    int line_no;
+    char *program_file;
+    CPU *cpu;
+    int status;
+} BatchJob;
+
+typedef struct Batch
+{
+    BatchJob *jobs;
+    int job_count;
+    SharedProgram *programs;
+    int program_count;
+    atomic_int next_job;
+} Batch;
+
+// load a text program or map an image once, for any number of CPUs
+int shared_program_open(char *filename, SharedProgram *shared)
+{
+    shared->filename = filename;
+    shared->program = NULL;
+    shared->image = NULL;
+    if (is_program_image(filename))
+    {
+        shared->image = malloc(sizeof(ProgramImage));
+        if (!shared->image || image_open(filename, shared->image))
+        {
+            free(shared->image);
+            shared->image = NULL;
+            return -1;
+        }
+    }
+    else
+    {
+        shared->program = load_program(filename);
+        if (!shared->program)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// run cpu on the shared program, which it will only read
+void shared_program_attach(CPU *cpu, SharedProgram *shared)
+{
+    cpu->program = shared->program;
+    cpu->image = shared->image;
+    cpu->shared_program = TRUE;
+}
+
+void shared_program_close(SharedProgram *shared)
+{
+    program_free(shared->program);
+    if (shared->image)
+    {
+        image_close(shared->image);
+        free(shared->image);
+    }
+    shared->program = NULL;
+    shared->image = NULL;
+}
+
+// find or load the program in filename, NULL when it cannot be loaded
+static SharedProgram *share_program(Batch *batch, char *filename)
+{
+    SharedProgram *shared;
+
+    for (int i = 0; i < batch->program_count; i++)
+    {
+        shared = &batch->programs[i];
+        if (strcmp(shared->filename, filename) == 0)
+        {
+            return shared->program || shared->image ? shared : NULL;
+        }
+    }
+
+    // a program that failed keeps its slot, so the error is reported once
+    shared = &batch->programs[batch->program_count++];
+    return shared_program_open(filename, shared) ? NULL : shared;
+}
+
+// split a job line into argv, in place
+static int split_line(char *line, char **argv)
+{
+    int argc = 0;
+    char *token;
+
+    argv[argc++] = "batch";
+    for (token = strtok(line, " \t\r"); token && argc < BATCH_MAX_ARGS - 1; token = strtok(NULL, " \t\r"))
+    {
+        argv[argc++] = token;
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+// read the job file and configure one CPU per job
+static int load_jobs(Batch *batch, char *job_file, char **text)
+{
+    FILE *fp = fopen(job_file, "rb");
+    long size;
+    char *line;
+    char *end;
+    int line_no = 0;
+    int capacity = 1;
+
+    if (!fp)
+    {
+        fprintf(stderr, "Error opening job file: %s\n", job_file);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    *text = malloc(size + 1);
+    if (!*text || fread(*text, 1, size, fp) != (size_t)size)
+    {
+        fclose(fp);
+        return -1;
+    }
+    (*text)[size] = '\0';
+    fclose(fp);
+
+    for (line = *text; (line = strchr(line, '\n')); line++)
+    {
+        capacity++;
+    }
+    batch->jobs = calloc(capacity, sizeof(BatchJob));
+    batch->programs = calloc(capacity, sizeof(SharedProgram));
+    if (!batch->jobs || !batch->programs)
+    {
+        return -1;
+    }
+
+    // option strings point into text, which lives until the batch is done
+    for (line = *text; line < *text + size; line = end + 1)
+    {
+        char *argv[BATCH_MAX_ARGS];
+        int argc;
+        int first;
+        BatchJob *job;
+
+        end = strchr(line, '\n');
+        if (!end)
+        {
+            end = *text + size;
+        }
+        *end = '\0';
+        line_no++;
+
+        argc = split_line(line, argv);
+        if (argc == 1 || argv[1][0] == '#')
+        {
+            continue;
+        }
+
+        job = &batch->jobs[batch->job_count];
+        job->line_no = line_no;
+        job->cpu = CPU_init();
+        if (!job->cpu)
+        {
+            return -1;
+        }
+        first = parse_run_options(job->cpu, argc, argv);
+        if (first < 0)
+        {
+            fprintf(stderr, "%s:%d: error: invalid job\n", job_file, line_no);
+            CPU_stop(job->cpu);
+            return -1;
+        }
+        batch->job_count++;
+        job->program_file = argv[first];
+
+        // workers share stdout, only the statistics table is printed
+        job->cpu->trace->level = TRACE_OFF;
+
+        if (job->cpu->stream_window == 0)
+        {
+            SharedProgram *shared = share_program(batch, job->program_file);
+            if (!shared)
+            {
+                // the job fails without running, the others still do
+                job->status = 1;
+                continue;
+            }
+            shared_program_attach(job->cpu, shared);
+        }
+    }
+    return 0;
+}
+
+static void *batch_worker(void *arg)
+{
+    Batch *batch = arg;
+    int id;
+
+    while ((id = atomic_fetch_add(&batch->next_job, 1)) < batch->job_count)
+    {
+        BatchJob *job = &batch->jobs[id];
+        if (!job->status)
+        {
+            job->status = CPU_run(job->cpu, job->program_file);
+        }
+    }
+    return NULL;
+}
+
+static void print_results(Batch *batch)
+{
+    printf("%-4s %-6s %12s %12s %9s %12s %10s  %s\n", "job", "status", "cycles", "instructions", "IPC", "stalled",
+           "host ms", "program");
+    for (int i = 0; i < batch->job_count; i++)
+    {
+        BatchJob *job = &batch->jobs[i];
+        CPU *cpu = job->cpu;
+        printf("%-4d %-6s %12d %12d %9.4f %12d %10.1f  %s\n", job->line_no, job->status ? "failed" : "ok",
+               cpu->clockCycle, cpu->simulation_count,
+               cpu->clockCycle ? (double)cpu->simulation_count / cpu->clockCycle : 0.0, cpu->stalled_cycles,
+               cpu->host_ns / 1e6, job->program_file);
+    }
+}
+
+static void run_jobs(Batch *batch, int threads)
+{
+    pthread_t *workers;
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > batch->job_count)
+    {
+        threads = batch->job_count;
+    }
+    workers = malloc(sizeof(pthread_t) * (threads > 0 ? threads : 1));
+    if (!workers)
+    {
+        // run them here instead
+        batch_worker(batch);
+        return;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, batch_worker, batch);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+// run every job of job_file on threads workers, 0 for one per host core
+int run_batch(char *job_file, int threads)
+{
+    Batch batch;
+    char *text = NULL;
+    int status = 0;
+
+    memset(&batch, 0, sizeof(batch));
+    atomic_init(&batch.next_job, 0);
+    if (load_jobs(&batch, job_file, &text))
+    {
+        status = 1;
+    }
+    else
+    {
+        run_jobs(&batch, threads);
+        print_results(&batch);
+        for (int i = 0; i < batch.job_count; i++)
+        {
+            status |= batch.jobs[i].status != 0;
+        }
+    }
+
+    for (int i = 0; i < batch.job_count; i++)
+    {
+        CPU_stop(batch.jobs[i].cpu);
+    }
+    for (int i = 0; i < batch.program_count; i++)
+    {
+        shared_program_close(&batch.programs[i]);
+    }
+    free(batch.programs);
+    free(batch.jobs);
+    free(text);
+    return status;
+}
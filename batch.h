@@ -0,0 +1,28 @@
+/*
+ * Description: Batch mode. Runs the jobs of a job file on a pool of threads,
+ *              one CPU context per job, and prints a statistics table.
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+#include "cpu.h"
+#include "program.h"
+#include "image.h"
+
+// a program loaded once and read by every CPU that runs it
+typedef struct SharedProgram
+{
+    char *filename;
+    Program *program;           // text programs
+    ProgramImage *image;        // binary images
+} SharedProgram;
+
+int shared_program_open(char *filename, SharedProgram *shared);
+
+void shared_program_attach(CPU *cpu, SharedProgram *shared);
+
+void shared_program_close(SharedProgram *shared);
+
+int run_batch(char *job_file, int threads);
+
+#endif
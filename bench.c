@@ -0,0 +1,130 @@
+/*
+ * Description: Host-side benchmarks. The parser benchmark writes a large
+ *              synthetic program and times the table driven decoder against
+ *              the original regex decoder on it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "parser.h"
+#include "bench.h"
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// write a random mix of every instruction form to fp
+static void write_synthetic_program(FILE *fp, int lines)
+{
+    srand(42);
+    for (int i = 0; i < lines; i++)
+    {
+        int rd = rand() % REG_COUNT;
+        int rs1 = rand() % REG_COUNT;
+        int rs2 = rand() % REG_COUNT;
+        int imm = rand() % 4096 - 1024;
+        int address = (i * 4) % 10000;
+
+        switch (rand() % 8)
+        {
+        case 0:
+            fprintf(fp, "%04d add R%d R%d #%d\n", address, rd, rs1, imm);
+            break;
+        case 1:
+            fprintf(fp, "%04d sub R%d R%d R%d\n", address, rd, rs1, rs2);
+            break;
+        case 2:
+            fprintf(fp, "%04d mul R%d R%d R%d\n", address, rd, rs1, rs2);
+            break;
+        case 3:
+            fprintf(fp, "%04d div R%d R%d #%d\n", address, rd, rs1, imm | 1);
+            break;
+        case 4:
+            fprintf(fp, "%04d ld R%d #%d\n", address, rd, (rand() % 16000) * 4);
+            break;
+        case 5:
+            fprintf(fp, "%04d st R%d R%d\n", address, rd, rs1);
+            break;
+        case 6:
+            fprintf(fp, "%04d set R%d #%d\n", address, rd, imm);
+            break;
+        case 7:
+            fprintf(fp, "%04d bgtz R%d #%d\n", address, rd, (rand() % lines) * 4);
+            break;
+        }
+    }
+}
+
+int bench_parser(int lines)
+{
+    char path[] = "/tmp/sim_bench_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *fp;
+    Program *table_code;
+    Instruction *regex_code;
+    RegexDecoder decoder;
+    int regex_size;
+    double start;
+    double table_time;
+    double regex_time;
+
+    if (fd < 0 || !(fp = fdopen(fd, "w")))
+    {
+        fprintf(stderr, "Error creating benchmark program\n");
+        return 1;
+    }
+    write_synthetic_program(fp, lines);
+    fclose(fp);
+
+    start = now_seconds();
+    initilize_parser(&decoder);
+    regex_code = load_instructions_regex(&decoder, path, &regex_size);
+    regex_time = now_seconds() - start;
+
+    start = now_seconds();
+    table_code = load_program(path);
+    table_time = now_seconds() - start;
+
+    unlink(path);
+    if (!table_code)
+    {
+        free(regex_code);
+        free_parser(&decoder);
+        return 1;
+    }
+
+    // both decoders must agree before the timings mean anything
+    if (table_code->size != regex_size)
+    {
+        fprintf(stderr, "Decoders disagree on program size: %d vs %d\n", table_code->size, regex_size);
+        return 1;
+    }
+    for (int i = 0; i < table_code->size; i++)
+    {
+        Instruction a;
+        Instruction *b = &regex_code[i];
+        program_get(table_code, i, &a);
+        if (a.opcode != b->opcode || a.rd != b->rd || a.rs1 != b->rs1 || a.rs2 != b->rs2 || a.op1 != b->op1)
+        {
+            fprintf(stderr, "Decoders disagree on instruction %d: %s\n", i, program_text(table_code, i));
+            return 1;
+        }
+    }
+
+    printf("Parser benchmark: %d instructions\n", lines);
+    printf("  regex decoder : %8.3f s  (%10.0f instructions/s)\n", regex_time, lines / regex_time);
+    printf("  table decoder : %8.3f s  (%10.0f instructions/s)\n", table_time, lines / table_time);
+    printf("  speedup       : %8.1fx\n", regex_time / table_time);
+
+    program_free(table_code);
+    free(regex_code);
+    free_parser(&decoder);
+    return 0;
+}
@@ -0,0 +1,10 @@
+/*
+ * Description: Host-side benchmarks for the simulator (load time, etc.)
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+int bench_parser(int lines);
+
+#endif
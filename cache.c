@@ -0,0 +1,226 @@
+/*
+ * Description: Set-associative cache model.
+ *
+ * A lookup compares the line address against the ways of one set. LRU
+ * keeps each set in recency order, so a hit moves the way to the front
+ * and the victim is always the last way; tree PLRU and random leave the
+ * ways in place and pick the victim from the tree bits or a generator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+const char *cache_policy_names[CACHE_POLICIES] = {"LRU", "PLRU", "random"};
+
+Cache *cache_create(const char *name, const CacheConfig *config, Cache *next, int memory_latency)
+{
+    Cache *cache = calloc(1, sizeof(Cache));
+
+    if (!cache)
+    {
+        return NULL;
+    }
+    cache->name = name;
+    cache->config = *config;
+    cache->sets = config->size / (config->assoc * config->line);
+    while ((1 << cache->line_shift) < config->line)
+    {
+        cache->line_shift++;
+    }
+    cache->next = next;
+    cache->memory_latency = memory_latency;
+    cache->tags = malloc(sizeof(uint32_t) * cache->sets * config->assoc);
+    cache->plru = malloc(sizeof(uint64_t) * cache->sets);
+    if (!cache->tags || !cache->plru)
+    {
+        cache_destroy(cache);
+        return NULL;
+    }
+    cache_reset(cache);
+    return cache;
+}
+
+void cache_destroy(Cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+    free(cache->tags);
+    free(cache->plru);
+    free(cache);
+}
+
+// every line invalid, counters cleared
+void cache_reset(Cache *cache)
+{
+    memset(cache->tags, 0xFF, sizeof(uint32_t) * cache->sets * cache->config.assoc);
+    memset(cache->plru, 0, sizeof(uint64_t) * cache->sets);
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    cache->random = 0x9E3779B9u;
+}
+
+// point the tree bits on the path to way away from it
+static void plru_touch(Cache *cache, int set, int way)
+{
+    int assoc = cache->config.assoc;
+    uint64_t bits = cache->plru[set];
+    int node = 1;
+
+    for (int half = assoc >> 1; half; half >>= 1)
+    {
+        int right = (way & half) != 0;
+        if (right)
+        {
+            bits &= ~(1ull << node);
+        }
+        else
+        {
+            bits |= 1ull << node;
+        }
+        node = node * 2 + right;
+    }
+    cache->plru[set] = bits;
+}
+
+// follow the tree bits to the pseudo least recently used way
+static int plru_victim(Cache *cache, int set)
+{
+    int node = 1;
+
+    while (node < cache->config.assoc)
+    {
+        node = node * 2 + (int)((cache->plru[set] >> node) & 1);
+    }
+    return node - cache->config.assoc;
+}
+
+static uint32_t next_random(Cache *cache)
+{
+    uint32_t x = cache->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return cache->random = x;
+}
+
+// look up addr, filling the line on a miss; returns the cycles it took
+static int cache_access(Cache *cache, unsigned int addr, bool write)
+{
+    int assoc = cache->config.assoc;
+    uint32_t line = addr >> cache->line_shift;
+    int set = line & (cache->sets - 1);
+    uint32_t *ways = cache->tags + (size_t)set * assoc;
+    uint32_t entry = line << 1 | write;
+    int latency = cache->config.latency;
+    int way;
+
+    cache->stats.accesses++;
+    for (way = 0; way < assoc; way++)
+    {
+        if ((ways[way] | 1) == (line << 1 | 1))
+        {
+            break;
+        }
+    }
+    if (way < assoc)
+    {
+        cache->stats.hits++;
+        entry |= ways[way] & 1;
+    }
+    else
+    {
+        cache->stats.misses++;
+        latency += cache->next ? cache_access(cache->next, addr, false) : cache->memory_latency;
+
+        // LRU and empty ways: the last way, the others pick among full sets
+        way = assoc - 1;
+        if (cache->config.policy != CACHE_LRU)
+        {
+            int empty;
+            for (empty = 0; empty < assoc && ways[empty] != CACHE_EMPTY; empty++)
+                ;
+            if (empty < assoc)
+            {
+                way = empty;
+            }
+            else
+            {
+                way = cache->config.policy == CACHE_PLRU ? plru_victim(cache, set) : next_random(cache) % assoc;
+            }
+        }
+        if (ways[way] != CACHE_EMPTY)
+        {
+            cache->stats.evictions++;
+            if (ways[way] & 1)
+            {
+                // write buffer, off the critical path
+                cache->stats.writebacks++;
+                if (cache->next)
+                {
+                    cache_access(cache->next, (ways[way] >> 1) << cache->line_shift, true);
+                }
+            }
+        }
+    }
+
+    if (cache->config.policy == CACHE_LRU)
+    {
+        for (; way > 0; way--)
+        {
+            ways[way] = ways[way - 1];
+        }
+    }
+    else if (cache->config.policy == CACHE_PLRU)
+    {
+        plru_touch(cache, set, way);
+    }
+    ways[way] = entry;
+    return latency;
+}
+
+// timed read, counted in the average access time
+int cache_read(Cache *cache, unsigned int addr)
+{
+    int latency = cache_access(cache, addr, false);
+
+    cache->stats.reads++;
+    cache->stats.read_cycles += latency;
+    return latency;
+}
+
+// write at commit, it updates the contents and counters but nothing waits
+void cache_write(Cache *cache, unsigned int addr)
+{
+    cache_access(cache, addr, true);
+}
+
+// an access that misses every level
+int cache_worst_latency(const Cache *cache)
+{
+    int latency = 0;
+
+    for (; cache; cache = cache->next)
+    {
+        latency += cache->config.latency;
+        if (!cache->next)
+        {
+            latency += cache->memory_latency;
+        }
+    }
+    return latency;
+}
+
+void cache_print_stats(const Cache *cache)
+{
+    const CacheConfig *c = &cache->config;
+    const CacheStats *s = &cache->stats;
+
+    printf("%s: %d bytes, %d-way, %d-byte lines, %s, latency %d\n", cache->name, c->size, c->assoc, c->line,
+           cache_policy_names[c->policy], c->latency);
+    printf("  accesses %ld, hits %ld, misses %ld (%.1f%%), evictions %ld, writebacks %ld\n", s->accesses, s->hits,
+           s->misses, s->accesses ? 100.0 * s->misses / s->accesses : 0.0, s->evictions, s->writebacks);
+}
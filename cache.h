@@ -0,0 +1,59 @@
+/*
+ * Description: Set-associative cache model. Each level keeps one 32-bit
+ *              word per line, the line address with a dirty bit, and is
+ *              write-back and write-allocate. Misses go to the next level
+ *              or to memory, and an access returns its latency.
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+#define CACHE_EMPTY 0xFFFFFFFFu
+
+typedef struct CacheStats
+{
+    long accesses;
+    long hits;
+    long misses;
+    long evictions;             // valid lines replaced
+    long writebacks;            // of which dirty, written to the next level
+    long reads;                 // timed accesses, for the average access time
+    long read_cycles;
+} CacheStats;
+
+typedef struct Cache
+{
+    const char *name;
+    CacheConfig config;
+    int sets;
+    int line_shift;
+    // sets * assoc entries, line address << 1 | dirty, CACHE_EMPTY when
+    // invalid; with LRU a set is kept most recently used first
+    uint32_t *tags;
+    uint64_t *plru;             // per set, tree bits 1 to assoc - 1
+    uint32_t random;            // xorshift state
+    int memory_latency;         // below the last level
+    struct Cache *next;         // next level, NULL for memory
+    CacheStats stats;
+} Cache;
+
+extern const char *cache_policy_names[CACHE_POLICIES];
+
+Cache *cache_create(const char *name, const CacheConfig *config, Cache *next, int memory_latency);
+
+void cache_destroy(Cache *cache);
+
+void cache_reset(Cache *cache);
+
+int cache_read(Cache *cache, unsigned int addr);
+
+void cache_write(Cache *cache, unsigned int addr);
+
+int cache_worst_latency(const Cache *cache);
+
+void cache_print_stats(const Cache *cache);
+
+#endif
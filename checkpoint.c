@@ -0,0 +1,438 @@
+/*
+ * Description: Simulator checkpoints.
+ *
+ * Structures are allocated from the configuration, so a restore reads the
+ * configuration section first, the run allocates for it, and the other
+ * sections are then read straight into the allocated arrays. Large arrays
+ * (data memory, the uop pool, predictor and cache tables) go to and from
+ * the file in one call each.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "checkpoint.h"
+#include "scheduler.h"
+#include "fu.h"
+#include "rename.h"
+#include "lsq.h"
+#include "cache.h"
+#include "predictor.h"
+#include "functional.h"
+
+#define SECTION_CONFIG      1
+#define SECTION_CORE        2   // pc, cycle, architectural registers, counters
+#define SECTION_MEMORY      3
+#define SECTION_PIPELINE    4   // uop pool, ROB, fetch buffer and latches
+#define SECTION_RS          5
+#define SECTION_RENAME      6
+#define SECTION_LSQ         7
+#define SECTION_FU          8
+#define SECTION_PREDICTOR   9
+#define SECTION_L1I         10
+#define SECTION_L1D         11
+#define SECTION_L2          12
+#define SECTION_FUNCTIONAL  13
+#define SECTION_STATS       14
+
+typedef struct Section
+{
+    uint32_t tag;
+    const char *name;
+    void (*state)(CPU *cpu, StateFile *f);
+    bool (*present)(const CPU *cpu);        // NULL when every run has it
+} Section;
+
+void state_data(StateFile *f, void *data, size_t size)
+{
+    size_t done;
+
+    if (f->error || size == 0)
+    {
+        return;
+    }
+    done = f->save ? fwrite(data, 1, size, f->fp) : fread(data, 1, size, f->fp);
+    if (done != size)
+    {
+        f->error = 1;
+    }
+}
+
+static void config_state(CPU *cpu, StateFile *f)
+{
+    STATE(f, cpu->config);
+}
+
+static void core_state(CPU *cpu, StateFile *f)
+{
+    STATE(f, cpu->pc);
+    STATE(f, cpu->clockCycle);
+    STATE(f, cpu->stalled_cycles);
+    STATE(f, cpu->memory_size);
+    STATE(f, cpu->flush);
+    STATE(f, cpu->halt_flag);
+    STATE(f, cpu->simulation_count);
+    STATE(f, cpu->branches);
+    STATE(f, cpu->mispredicts);
+    STATE(f, cpu->fault);
+    STATE(f, cpu->fast_forwarded);
+    STATE_ARRAY(f, cpu->regs, REG_COUNT);
+    STATE_ARRAY(f, cpu->regs_copy, REG_COUNT);
+}
+
+static void memory_state(CPU *cpu, StateFile *f)
+{
+    STATE_ARRAY(f, cpu->data_mem, MEMORY_SIZE);
+}
+
+static void pipeline_state(CPU *cpu, StateFile *f)
+{
+    STATE(f, cpu->uop_head);
+    STATE(f, cpu->uop_tail);
+    STATE_ARRAY(f, cpu->uops, cpu->uop_count);
+    STATE(f, cpu->fetch_halted);
+    STATE(f, cpu->fetch_line);
+    STATE(f, cpu->fetch_ready);
+    STATE(f, cpu->refill_seq);
+    STATE(f, cpu->refill_cycle);
+    STATE(f, cpu->fetch.head);
+    STATE(f, cpu->fetch.count);
+    STATE_ARRAY(f, cpu->fetch.uop, cpu->fetch.size);
+    STATE(f, cpu->decode);
+    STATE(f, cpu->analyze);
+    STATE(f, cpu->read_registers);
+    STATE(f, cpu->issue);
+    STATE(f, cpu->writeback);
+    STATE(f, cpu->retire);
+    STATE(f, cpu->completed_count);
+    STATE_ARRAY(f, cpu->completed, cpu->uop_count);
+    STATE(f, cpu->rob.head);
+    STATE(f, cpu->rob.tail);
+    STATE(f, cpu->rob.count);
+    STATE_ARRAY(f, cpu->rob.entries, CONFIG(cpu, rob_size));
+}
+
+static void rs_state(CPU *cpu, StateFile *f)
+{
+    ReservationStation *rs = &cpu->rs;
+    int size = CONFIG(cpu, rs_size);
+
+    STATE(f, rs->count);
+    STATE_ARRAY(f, rs->entries, size);
+    STATE_ARRAY(f, rs->valid, rs->words);
+    STATE_ARRAY(f, rs->ready, rs->words * FU_CLASSES);
+    STATE_ARRAY(f, rs->older, rs->words * size);
+    STATE_ARRAY(f, rs->waiting, rs->words * cpu->rename->size);
+}
+
+static void rename_state(CPU *cpu, StateFile *f)
+{
+    RenameState *rn = cpu->rename;
+
+    STATE_ARRAY(f, rn->value, rn->size);
+    STATE_ARRAY(f, rn->ready, rn->size);
+    STATE(f, rn->map);
+    STATE(f, rn->committed);
+    STATE_ARRAY(f, rn->free_list, rn->size);
+    STATE(f, rn->allocated);
+    STATE(f, rn->free_count);
+    STATE_ARRAY(f, rn->checkpoints, CONFIG(cpu, checkpoints));
+    STATE(f, rn->checkpoint_head);
+    STATE(f, rn->checkpoint_count);
+    STATE(f, rn->stats);
+}
+
+static void queue_state(LSQueue *q, StateFile *f)
+{
+    STATE(f, q->head);
+    STATE(f, q->count);
+    STATE_ARRAY(f, q->entries, q->size);
+}
+
+static void lsq_state(CPU *cpu, StateFile *f)
+{
+    queue_state(&cpu->lsq->loads, f);
+    queue_state(&cpu->lsq->stores, f);
+    STATE(f, cpu->lsq->stats);
+}
+
+static void fu_state(CPU *cpu, StateFile *f)
+{
+    FUPool *pool = cpu->fu_pool;
+
+    STATE_ARRAY(f, pool->free_at, pool->first[FU_CLASSES]);
+    STATE_ARRAY(f, pool->wheel, pool->wheel_size * pool->slot_size);
+    STATE_ARRAY(f, pool->wheel_count, pool->wheel_size);
+    STATE(f, pool->stats);
+}
+
+static void cache_state(Cache *cache, StateFile *f)
+{
+    STATE_ARRAY(f, cache->tags, cache->sets * cache->config.assoc);
+    STATE_ARRAY(f, cache->plru, cache->sets);
+    STATE(f, cache->random);
+    STATE(f, cache->stats);
+}
+
+static void l1i_state(CPU *cpu, StateFile *f)
+{
+    cache_state(cpu->l1i, f);
+}
+
+static void l1d_state(CPU *cpu, StateFile *f)
+{
+    cache_state(cpu->l1d, f);
+}
+
+static void l2_state(CPU *cpu, StateFile *f)
+{
+    cache_state(cpu->l2, f);
+}
+
+static bool has_l1i(const CPU *cpu)
+{
+    return cpu->l1i != NULL;
+}
+
+static bool has_l1d(const CPU *cpu)
+{
+    return cpu->l1d != NULL;
+}
+
+static bool has_l2(const CPU *cpu)
+{
+    return cpu->l2 != NULL;
+}
+
+static void functional_state(CPU *cpu, StateFile *f)
+{
+    FunctionalModel *fm = cpu->functional;
+
+    STATE(f, fm->pc);
+    STATE(f, fm->regs);
+    // the pages the model stored to, the rest it reads from data memory
+    for (int p = 0; p < FUNCTIONAL_PAGES; p++)
+    {
+        int present = fm->pages[p] != NULL;
+        STATE(f, present);
+        if (!f->save && !present)
+        {
+            functional_drop_page(cpu, p);
+        }
+        else if (!f->save && !functional_page(cpu, p))
+        {
+            f->error = TRUE;
+            return;
+        }
+        if (present)
+        {
+            STATE_ARRAY(f, fm->pages[p], FUNCTIONAL_PAGE_WORDS);
+        }
+    }
+    STATE(f, fm->executed);
+    STATE_ARRAY(f, fm->steps, cpu->uop_count);
+    STATE(f, fm->step_count);
+    STATE(f, fm->cursor);
+    STATE(f, fm->wrong_path);
+}
+
+static void stats_state(CPU *cpu, StateFile *f)
+{
+    STATE(f, cpu->frontend);
+    STATE(f, cpu->wrong_path);
+    STATE(f, cpu->commit);
+    STATE(f, cpu->writeback_stats);
+    STATE(f, cpu->issue_stats);
+}
+
+static const Section sections[] = {
+    {SECTION_CONFIG, "config", config_state, NULL},
+    {SECTION_CORE, "core", core_state, NULL},
+    {SECTION_MEMORY, "memory", memory_state, NULL},
+    {SECTION_PIPELINE, "pipeline", pipeline_state, NULL},
+    {SECTION_RS, "reservation stations", rs_state, NULL},
+    {SECTION_RENAME, "rename", rename_state, NULL},
+    {SECTION_LSQ, "load/store queues", lsq_state, NULL},
+    {SECTION_FU, "functional units", fu_state, NULL},
+    {SECTION_PREDICTOR, "predictor", predictor_state, NULL},
+    {SECTION_L1I, "L1I", l1i_state, has_l1i},
+    {SECTION_L1D, "L1D", l1d_state, has_l1d},
+    {SECTION_L2, "L2", l2_state, has_l2},
+    {SECTION_FUNCTIONAL, "functional model", functional_state, NULL},
+    {SECTION_STATS, "statistics", stats_state, NULL},
+};
+
+static void header_init(CheckpointHeader *header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, 4);
+    header->version = CHECKPOINT_VERSION;
+    header->stage_size = sizeof(Stage);
+    header->config_size = sizeof(CPUConfig);
+    header->reg_count = REG_COUNT;
+    header->memory_size = MEMORY_SIZE;
+}
+
+// open filename and check its header, NULL on error
+static FILE *checkpoint_open(const char *filename)
+{
+    CheckpointHeader header, expected;
+    FILE *fp = fopen(filename, "rb");
+
+    if (!fp)
+    {
+        fprintf(stderr, "Error: cannot open checkpoint %s\n", filename);
+        return NULL;
+    }
+    header_init(&expected);
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, expected.magic, 4) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+    if (header.version != expected.version)
+    {
+        fprintf(stderr, "Error: %s is a version %u checkpoint, this build reads version %u\n", filename,
+                header.version, expected.version);
+        fclose(fp);
+        return NULL;
+    }
+    if (memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        fprintf(stderr, "Error: %s was written by a build with another state layout\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+// write the whole state of cpu between two cycles
+int checkpoint_save(CPU *cpu, const char *filename)
+{
+    CheckpointHeader header;
+    StateFile f = {fopen(filename, "wb"), 1, 0};
+
+    if (!f.fp)
+    {
+        fprintf(stderr, "Error: cannot create checkpoint %s\n", filename);
+        return -1;
+    }
+    header_init(&header);
+    STATE(&f, header);
+    for (int i = 0; i < (int)ARRLEN(sections) && !f.error; i++)
+    {
+        const Section *s = &sections[i];
+        SectionHeader section = {s->tag, 0, 0};
+        long start;
+        long end;
+
+        if (s->present && !s->present(cpu))
+        {
+            continue;
+        }
+        // the size is only known once the section is written
+        start = ftell(f.fp);
+        STATE(&f, section);
+        s->state(cpu, &f);
+        end = ftell(f.fp);
+        section.size = end - start - sizeof(section);
+        if (fseek(f.fp, start, SEEK_SET) || (STATE(&f, section), f.error) || fseek(f.fp, end, SEEK_SET))
+        {
+            f.error = 1;
+        }
+    }
+    if (fclose(f.fp) || f.error)
+    {
+        fprintf(stderr, "Error: writing checkpoint %s failed\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// the configuration a checkpoint was taken with, to allocate for it
+int checkpoint_read_config(const char *filename, CPUConfig *config)
+{
+    SectionHeader section;
+    FILE *fp = checkpoint_open(filename);
+    int status = 0;
+
+    if (!fp)
+    {
+        return -1;
+    }
+    if (fread(&section, sizeof(section), 1, fp) != 1 || section.tag != SECTION_CONFIG ||
+        section.size != sizeof(CPUConfig) || fread(config, sizeof(CPUConfig), 1, fp) != 1)
+    {
+        fprintf(stderr, "Error: %s has no configuration section\n", filename);
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+// replace the state of cpu, allocated for the configuration of the
+// checkpoint, with the one saved in it
+int checkpoint_restore(CPU *cpu, const char *filename)
+{
+    CPUConfig config = cpu->config;
+    bool seen[ARRLEN(sections)] = {false};
+    SectionHeader section;
+    StateFile f = {checkpoint_open(filename), 0, 0};
+
+    if (!f.fp)
+    {
+        return -1;
+    }
+    while (fread(&section, sizeof(section), 1, f.fp) == 1)
+    {
+        const Section *s = NULL;
+        long start = ftell(f.fp);
+        int i;
+
+        for (i = 0; i < (int)ARRLEN(sections); i++)
+        {
+            if (sections[i].tag == section.tag)
+            {
+                s = &sections[i];
+                break;
+            }
+        }
+        if (!s)
+        {
+            // written by a newer build for state this one does not have
+            fseek(f.fp, (long)section.size, SEEK_CUR);
+            continue;
+        }
+        if (s->present && !s->present(cpu))
+        {
+            fprintf(stderr, "Error: checkpoint %s has %s state this run has no place for\n", filename, s->name);
+            fclose(f.fp);
+            return -1;
+        }
+        s->state(cpu, &f);
+        if (f.error || (uint64_t)(ftell(f.fp) - start) != section.size)
+        {
+            fprintf(stderr, "Error: checkpoint %s: %s state is %s\n", filename, s->name,
+                    f.error ? "truncated" : "the wrong size");
+            fclose(f.fp);
+            return -1;
+        }
+        seen[i] = true;
+    }
+    fclose(f.fp);
+    if (memcmp(&config, &cpu->config, sizeof(config)) != 0)
+    {
+        fprintf(stderr, "Error: checkpoint %s changed configuration while restoring\n", filename);
+        return -1;
+    }
+    for (int i = 0; i < (int)ARRLEN(sections); i++)
+    {
+        if (!seen[i] && (!sections[i].present || sections[i].present(cpu)))
+        {
+            fprintf(stderr, "Error: checkpoint %s has no %s state\n", filename, sections[i].name);
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Description: Simulator checkpoints. A checkpoint is taken between two
+ *              cycles and holds everything the next cycle reads, so a run
+ *              restored from it takes the same cycles as one that never
+ *              stopped. Each module writes and reads its state through the
+ *              same function, the direction is in the StateFile.
+ */
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+#include <stdio.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define CHECKPOINT_MAGIC "SCKP"
+#define CHECKPOINT_VERSION 1
+
+/*
+ * File layout (host byte order, only read back by the same build):
+ *   CheckpointHeader
+ *   sections, each a SectionHeader followed by size bytes
+ * The configuration section comes first. A reader skips sections it does
+ * not know and fails on a missing one; a new field bumps the version.
+ */
+typedef struct CheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    // layout checks, a build with other sizes cannot use the file
+    uint32_t stage_size;
+    uint32_t config_size;
+    uint32_t reg_count;
+    uint32_t memory_size;
+} CheckpointHeader;
+
+typedef struct SectionHeader
+{
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t size;
+} SectionHeader;
+
+typedef struct StateFile
+{
+    FILE *fp;
+    int save;                   // writing, else reading
+    int error;                  // a short read or write happened
+} StateFile;
+
+void state_data(StateFile *f, void *data, size_t size);
+
+// a field or the first count elements of an array
+#define STATE(f, field) state_data((f), &(field), sizeof(field))
+#define STATE_ARRAY(f, array, count) state_data((f), (array), sizeof(*(array)) * (size_t)(count))
+
+int checkpoint_save(CPU *cpu, const char *filename);
+
+int checkpoint_read_config(const char *filename, CPUConfig *config);
+
+int checkpoint_restore(CPU *cpu, const char *filename);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Description: INI configuration files.
+ *
+ *   [rob]        size
+ *   [rs]         size
+ *   [rename]     registers checkpoints        0 registers: 16 + ROB size
+ *   [lsq]        loads stores
+ *   [predictor]  btb_size pt_size counter_bits type btb_assoc history_bits
+ *                tage_tables wrong_path
+ *   [width]      fetch issue writeback commit fetch_block fetch_buffer
+ *   [units]      add mul div mem branch      units per class
+ *   [latency]    add mul div mem branch      cycles from issue to result
+ *   [interval]   add mul div mem branch      cycles between issues to a unit
+ *   [pipelined]  add mul div mem branch      0: a unit is busy for the latency
+ *   [l1i]        size assoc line latency policy
+ *   [l1d]        size assoc line latency policy
+ *   [l2]         size assoc line latency policy
+ *   [memory]     latency
+ *
+ * Cache sizes and lines are in bytes, size 0 leaves the level out. The
+ * policy is 0 for LRU, 1 for tree pseudo-LRU and 2 for random. The
+ * predictor type is bimodal, gshare, tournament or TAGE, or its number 0-3.
+ *
+ * Keys are "name = value", comments start with '#' or ';'. Keys that are
+ * not given keep their previous value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "config.h"
+#include "predictor.h"
+
+typedef struct ConfigKey
+{
+    const char *section;
+    const char *name;
+    size_t offset;
+    int min;
+} ConfigKey;
+
+static const ConfigKey config_keys[] = {
+    {"rob", "size", offsetof(CPUConfig, rob_size), 2},
+    {"rs", "size", offsetof(CPUConfig, rs_size), 2},
+    {"rename", "registers", offsetof(CPUConfig, phys_regs), 0},
+    {"rename", "checkpoints", offsetof(CPUConfig, checkpoints), 1},
+    {"lsq", "loads", offsetof(CPUConfig, lq_size), 1},
+    {"lsq", "stores", offsetof(CPUConfig, sq_size), 1},
+    {"predictor", "btb_size", offsetof(CPUConfig, btb_size), 1},
+    {"predictor", "pt_size", offsetof(CPUConfig, pt_size), 1},
+    {"predictor", "counter_bits", offsetof(CPUConfig, pt_counter_bits), 1},
+    {"predictor", "type", offsetof(CPUConfig, predictor), 0},
+    {"predictor", "btb_assoc", offsetof(CPUConfig, btb_assoc), 1},
+    {"predictor", "history_bits", offsetof(CPUConfig, history_bits), 0},
+    {"predictor", "tage_tables", offsetof(CPUConfig, tage_tables), 1},
+    {"predictor", "wrong_path", offsetof(CPUConfig, wrong_path), 0},
+    {"width", "fetch", offsetof(CPUConfig, fetch_width), 1},
+    {"width", "issue", offsetof(CPUConfig, issue_width), 1},
+    {"width", "writeback", offsetof(CPUConfig, writeback_width), 1},
+    {"width", "commit", offsetof(CPUConfig, commit_width), 1},
+    {"width", "fetch_block", offsetof(CPUConfig, fetch_block), 1},
+    {"width", "fetch_buffer", offsetof(CPUConfig, fetch_buffer), 0},
+#define FU_KEYS(section, field, min)                                        \
+    {section, "add", offsetof(CPUConfig, fu[FU_ADD].field), min},           \
+    {section, "mul", offsetof(CPUConfig, fu[FU_MUL].field), min},           \
+    {section, "div", offsetof(CPUConfig, fu[FU_DIV].field), min},           \
+    {section, "mem", offsetof(CPUConfig, fu[FU_MEM].field), min},           \
+    {section, "branch", offsetof(CPUConfig, fu[FU_BRANCH].field), min}
+    FU_KEYS("units", count, 1),
+    FU_KEYS("latency", latency, 1),
+    FU_KEYS("interval", interval, 1),
+    FU_KEYS("pipelined", pipelined, 0),
+#define CACHE_KEYS(section, level)                                          \
+    {section, "size", offsetof(CPUConfig, level.size), 0},                  \
+    {section, "assoc", offsetof(CPUConfig, level.assoc), 1},                \
+    {section, "line", offsetof(CPUConfig, level.line), 4},                  \
+    {section, "latency", offsetof(CPUConfig, level.latency), 1},            \
+    {section, "policy", offsetof(CPUConfig, level.policy), 0}
+    CACHE_KEYS("l1i", l1i),
+    CACHE_KEYS("l1d", l1d),
+    CACHE_KEYS("l2", l2),
+    {"memory", "latency", offsetof(CPUConfig, memory_latency), 1},
+};
+
+#define CONFIG_KEYS (int)(sizeof(config_keys) / sizeof(config_keys[0]))
+
+#define CONFIG_FIELD(config, key) ((int *)((char *)(config) + (key)->offset))
+
+// the value is a predictor name or number
+#define CONFIG_PREDICTOR(key) ((key)->offset == offsetof(CPUConfig, predictor))
+
+void config_defaults(CPUConfig *config)
+{
+    static const CPUConfig defaults = DEFAULT_CONFIG;
+    *config = defaults;
+}
+
+static char *trim(char *text)
+{
+    char *end;
+
+    while (*text == ' ' || *text == '\t')
+    {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+    {
+        end--;
+    }
+    *end = '\0';
+    return text;
+}
+
+// apply the keys of filename on top of config
+int config_load(CPUConfig *config, const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    char buffer[256];
+    char section[32] = "";
+    int line_no = 0;
+    CPUConfig loaded = *config;
+
+    if (!fp)
+    {
+        fprintf(stderr, "Error opening config file: %s\n", filename);
+        return -1;
+    }
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        char *line = trim(buffer);
+        char *value;
+        char *end;
+        const ConfigKey *key = NULL;
+        long number;
+
+        line_no++;
+        if (!*line || *line == '#' || *line == ';')
+        {
+            continue;
+        }
+        if (*line == '[')
+        {
+            end = strchr(line, ']');
+            if (!end || end[1] || end - line - 1 >= (long)sizeof(section))
+            {
+                fprintf(stderr, "%s:%d: error: bad section header\n", filename, line_no);
+                fclose(fp);
+                return -1;
+            }
+            *end = '\0';
+            strcpy(section, trim(line + 1));
+            continue;
+        }
+
+        value = strchr(line, '=');
+        if (!value)
+        {
+            fprintf(stderr, "%s:%d: error: expected name = value\n", filename, line_no);
+            fclose(fp);
+            return -1;
+        }
+        *value++ = '\0';
+        line = trim(line);
+        value = trim(value);
+        for (int i = 0; i < CONFIG_KEYS; i++)
+        {
+            if (strcmp(config_keys[i].section, section) == 0 && strcmp(config_keys[i].name, line) == 0)
+            {
+                key = &config_keys[i];
+                break;
+            }
+        }
+        if (!key)
+        {
+            fprintf(stderr, "%s:%d: error: unknown key '%s' in section [%s]\n", filename, line_no, line, section);
+            fclose(fp);
+            return -1;
+        }
+        if (CONFIG_PREDICTOR(key))
+        {
+            number = predictor_parse(value, (int)strlen(value));
+            end = number < 0 ? value : value + strlen(value);
+        }
+        else
+        {
+            number = strtol(value, &end, 10);
+        }
+        if (end == value || *end || number < key->min || number > 1 << 20)
+        {
+            fprintf(stderr, "%s:%d: error: invalid value '%s' for %s\n", filename, line_no, value, line);
+            fclose(fp);
+            return -1;
+        }
+        *CONFIG_FIELD(&loaded, key) = (int)number;
+    }
+    fclose(fp);
+
+    *config = loaded;
+    return 0;
+}
+
+static int is_power_of_two(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// a whole power of two number of sets of power of two lines
+static int check_cache(const char *section, const CacheConfig *cache)
+{
+    if (cache->size == 0)
+    {
+        return 0;
+    }
+    if (!is_power_of_two(cache->line) || cache->size % (cache->assoc * cache->line) ||
+        !is_power_of_two(cache->size / (cache->assoc * cache->line)))
+    {
+        fprintf(stderr, "Error: [%s] line and size / (assoc * line) must be powers of two\n", section);
+        return -1;
+    }
+    if (cache->policy >= CACHE_POLICIES || cache->latency > 64 ||
+        (cache->policy == CACHE_PLRU && (!is_power_of_two(cache->assoc) || cache->assoc > 64)))
+    {
+        fprintf(stderr, "Error: [%s] policy is 0 to 2, latency at most 64, PLRU needs 1 to 64 ways in a power of two\n",
+                section);
+        return -1;
+    }
+    return 0;
+}
+
+// check a configuration before structures are sized from it
+int config_check(const CPUConfig *config)
+{
+    for (int i = 0; i < CONFIG_KEYS; i++)
+    {
+        const ConfigKey *key = &config_keys[i];
+        if (*CONFIG_FIELD(config, key) < key->min)
+        {
+            fprintf(stderr, "Error: [%s] %s must be at least %d\n", key->section, key->name, key->min);
+            return -1;
+        }
+    }
+    if (config->fetch_width > MAX_WIDTH || config->issue_width > MAX_WIDTH || config->writeback_width > MAX_WIDTH ||
+        config->commit_width > MAX_WIDTH)
+    {
+        fprintf(stderr, "Error: [width] widths must be at most %d\n", MAX_WIDTH);
+        return -1;
+    }
+    for (int fu = 0; fu < FU_CLASSES; fu++)
+    {
+        if (config->fu[fu].pipelined > 1 || config->fu[fu].latency > 64)
+        {
+            fprintf(stderr, "Error: [pipelined] is 0 or 1 and [latency] at most 64\n");
+            return -1;
+        }
+    }
+    if (config->fetch_buffer && config->fetch_buffer < config->fetch_width)
+    {
+        fprintf(stderr, "Error: [width] fetch_buffer must be 0 or at least fetch\n");
+        return -1;
+    }
+    if (check_cache("l1i", &config->l1i) || check_cache("l1d", &config->l1d) || check_cache("l2", &config->l2))
+    {
+        return -1;
+    }
+    if (config->memory_latency > 1000)
+    {
+        fprintf(stderr, "Error: [memory] latency must be at most 1000\n");
+        return -1;
+    }
+    if (config->pt_counter_bits > 16)
+    {
+        fprintf(stderr, "Error: [predictor] counter_bits must be at most 16\n");
+        return -1;
+    }
+    if (config->predictor >= PREDICTORS || config->history_bits > 64 || config->tage_tables > TAGE_MAX_TABLES)
+    {
+        fprintf(stderr, "Error: [predictor] type is 0 to %d, history_bits at most 64, tage_tables at most %d\n",
+                PREDICTORS - 1, TAGE_MAX_TABLES);
+        return -1;
+    }
+    if (config->wrong_path > 1)
+    {
+        fprintf(stderr, "Error: [predictor] wrong_path is 0 or 1\n");
+        return -1;
+    }
+    if (config->btb_size % config->btb_assoc)
+    {
+        fprintf(stderr, "Error: [predictor] btb_size must be a multiple of btb_assoc\n");
+        return -1;
+    }
+#ifdef FIXED_CONFIG
+    if (memcmp(config, &fixed_config, sizeof(fixed_config)) != 0)
+    {
+        fprintf(stderr, "Error: this simulator was built with a fixed configuration\n");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// print config in the file format
+void config_write(const CPUConfig *config, FILE *fp)
+{
+    const char *section = "";
+
+    for (int i = 0; i < CONFIG_KEYS; i++)
+    {
+        const ConfigKey *key = &config_keys[i];
+        if (strcmp(section, key->section) != 0)
+        {
+            section = key->section;
+            fprintf(fp, "%s[%s]\n", i ? "\n" : "", section);
+        }
+        if (CONFIG_PREDICTOR(key))
+        {
+            fprintf(fp, "%s = %s\n", key->name, predictor_name(*CONFIG_FIELD(config, key)));
+        }
+        else
+        {
+            fprintf(fp, "%s = %d\n", key->name, *CONFIG_FIELD(config, key));
+        }
+    }
+}
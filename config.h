@@ -0,0 +1,258 @@
+/*
+ * Description: Microarchitecture configuration. Sizes, widths, latencies
+ *              and predictor parameters are read from an INI file at run
+ *              time; a -DFIXED_CONFIG build turns them into constants.
+ */
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+#include <stdio.h>
+
+// widest front end, sizes the pipeline latches
+#define MAX_WIDTH 8
+
+// functional unit classes
+#define FU_ADD      0       // set, add, sub and ret
+#define FU_MUL      1
+#define FU_DIV      2
+#define FU_MEM      3
+#define FU_BRANCH   4
+#define FU_CLASSES  5
+
+// cache replacement policies
+#define CACHE_LRU       0
+#define CACHE_PLRU      1   // tree pseudo-LRU, power of two ways
+#define CACHE_RANDOM    2
+#define CACHE_POLICIES  3
+
+// branch direction predictors
+#define PREDICTOR_BIMODAL       0   // pattern table indexed by pc
+#define PREDICTOR_GSHARE        1   // pc xor global history
+#define PREDICTOR_TOURNAMENT    2   // bimodal and gshare with a chooser
+#define PREDICTOR_TAGE          3   // tagged tables of geometric history lengths
+#define PREDICTORS              4
+#define TAGE_MAX_TABLES         8
+
+// defaults, these reproduce the original fixed pipeline; a FIXED_CONFIG
+// build can override any of them with -D
+#ifndef ROB_SIZE
+#define ROB_SIZE 8
+#endif
+#ifndef RS_SIZE
+#define RS_SIZE 4
+#endif
+#ifndef PHYS_REGS
+#define PHYS_REGS 0         // 0: 16 architectural plus one per ROB entry
+#endif
+#ifndef CHECKPOINTS
+#define CHECKPOINTS 8
+#endif
+#ifndef LQ_SIZE
+#define LQ_SIZE 8
+#endif
+#ifndef SQ_SIZE
+#define SQ_SIZE 8
+#endif
+#ifndef BTB_SIZE
+#define BTB_SIZE 16
+#endif
+#ifndef PT_SIZE
+#define PT_SIZE 16
+#endif
+#ifndef PT_COUNTER_BITS
+#define PT_COUNTER_BITS 3
+#endif
+#ifndef PREDICTOR
+#define PREDICTOR PREDICTOR_BIMODAL
+#endif
+#ifndef BTB_ASSOC
+#define BTB_ASSOC 1
+#endif
+#ifndef HISTORY_BITS
+#define HISTORY_BITS 0      // 0: log2(pt_size), or 64 for the longest TAGE table
+#endif
+#ifndef TAGE_TABLES
+#define TAGE_TABLES 4
+#endif
+#ifndef WRONG_PATH
+#define WRONG_PATH 1        // 0: fetch stops when it leaves the right path
+#endif
+#ifndef FETCH_WIDTH
+#define FETCH_WIDTH 1
+#endif
+#ifndef ISSUE_WIDTH
+#define ISSUE_WIDTH 1
+#endif
+#ifndef WRITEBACK_WIDTH
+#define WRITEBACK_WIDTH 1
+#endif
+#ifndef COMMIT_WIDTH
+#define COMMIT_WIDTH 1
+#endif
+#ifndef FETCH_BLOCK
+#define FETCH_BLOCK 4
+#endif
+#ifndef FETCH_BUFFER
+#define FETCH_BUFFER 0      // 0: fetch_width, a plain latch
+#endif
+#ifndef ADD_LATENCY
+#define ADD_LATENCY 1
+#endif
+#ifndef MUL_LATENCY
+#define MUL_LATENCY 2
+#endif
+#ifndef DIV_LATENCY
+#define DIV_LATENCY 3
+#endif
+#ifndef MEM_LATENCY
+#define MEM_LATENCY 4
+#endif
+#ifndef BRANCH_LATENCY
+#define BRANCH_LATENCY 1
+#endif
+// units per class, issue interval and pipelining, the same for every class
+#ifndef FU_UNITS
+#define FU_UNITS 1
+#endif
+#ifndef FU_INTERVAL
+#define FU_INTERVAL 1
+#endif
+#ifndef FU_PIPELINED
+#define FU_PIPELINED 1
+#endif
+// caches, a size of 0 leaves the level out: without an L1D a load reads
+// data memory in the mem latency alone, without an L1I fetch never waits
+#ifndef L1D_SIZE
+#define L1D_SIZE 0
+#endif
+#ifndef L1D_ASSOC
+#define L1D_ASSOC 4
+#endif
+#ifndef L1D_LINE
+#define L1D_LINE 32
+#endif
+#ifndef L1D_LATENCY
+#define L1D_LATENCY 2
+#endif
+#ifndef L1D_POLICY
+#define L1D_POLICY CACHE_LRU
+#endif
+#ifndef L1I_SIZE
+#define L1I_SIZE 0
+#endif
+#ifndef L1I_ASSOC
+#define L1I_ASSOC 2
+#endif
+#ifndef L1I_LINE
+#define L1I_LINE 32
+#endif
+#ifndef L1I_LATENCY
+#define L1I_LATENCY 1
+#endif
+#ifndef L1I_POLICY
+#define L1I_POLICY CACHE_LRU
+#endif
+#ifndef L2_SIZE
+#define L2_SIZE 0
+#endif
+#ifndef L2_ASSOC
+#define L2_ASSOC 8
+#endif
+#ifndef L2_LINE
+#define L2_LINE 64
+#endif
+#ifndef L2_LATENCY
+#define L2_LATENCY 10
+#endif
+#ifndef L2_POLICY
+#define L2_POLICY CACHE_LRU
+#endif
+#ifndef MEMORY_LATENCY
+#define MEMORY_LATENCY 100
+#endif
+
+typedef struct FUConfig
+{
+    int count;                  // units of the class
+    int latency;                // cycles from issue to result
+    int interval;               // cycles between issues to one pipelined unit
+    int pipelined;              // 0: a unit is busy for the whole latency
+} FUConfig;
+
+typedef struct CacheConfig
+{
+    int size;                   // bytes, 0 for no cache
+    int assoc;
+    int line;                   // bytes
+    int latency;                // cycles for a hit
+    int policy;                 // CACHE_LRU, CACHE_PLRU or CACHE_RANDOM
+} CacheConfig;
+
+typedef struct CPUConfig
+{
+    // structure sizes
+    int rob_size;
+    int rs_size;
+    int phys_regs;              // physical register file, 0 to size it from the ROB
+    int checkpoints;            // rename map checkpoints, one per branch in flight
+    int lq_size;                // load queue
+    int sq_size;                // store queue
+    int btb_size;
+    int pt_size;
+    int pt_counter_bits;        // saturating counter width, taken at half range
+    int predictor;              // PREDICTOR_BIMODAL to PREDICTOR_TAGE
+    int btb_assoc;              // ways of the branch target buffer
+    int history_bits;           // global history length, 0 for the predictor's default
+    int tage_tables;            // tagged tables in front of the TAGE base predictor
+    int wrong_path;             // fetch and execute past a mispredicted branch
+    // instructions per cycle
+    int fetch_width;
+    int issue_width;
+    int writeback_width;
+    int commit_width;
+    int fetch_block;            // aligned fetch block in instructions, fetch stops at its end
+    int fetch_buffer;           // instructions between fetch and decode, 0 for fetch_width
+    // functional units, indexed by class
+    FUConfig fu[FU_CLASSES];
+    // cache hierarchy, the L2 is shared
+    CacheConfig l1i;
+    CacheConfig l1d;
+    CacheConfig l2;
+    int memory_latency;         // cycles added by a miss in the last level
+} CPUConfig;
+
+#define DEFAULT_CONFIG                                                                              \
+    {                                                                                               \
+        ROB_SIZE, RS_SIZE, PHYS_REGS, CHECKPOINTS, LQ_SIZE, SQ_SIZE, BTB_SIZE, PT_SIZE,             \
+            PT_COUNTER_BITS, PREDICTOR, BTB_ASSOC, HISTORY_BITS, TAGE_TABLES, WRONG_PATH,           \
+            FETCH_WIDTH, ISSUE_WIDTH, WRITEBACK_WIDTH, COMMIT_WIDTH, FETCH_BLOCK, FETCH_BUFFER,     \
+        {                                                                                           \
+            {FU_UNITS, ADD_LATENCY, FU_INTERVAL, FU_PIPELINED},                                     \
+                {FU_UNITS, MUL_LATENCY, FU_INTERVAL, FU_PIPELINED},                                 \
+                {FU_UNITS, DIV_LATENCY, FU_INTERVAL, FU_PIPELINED},                                 \
+                {FU_UNITS, MEM_LATENCY, FU_INTERVAL, FU_PIPELINED},                                 \
+                {FU_UNITS, BRANCH_LATENCY, FU_INTERVAL, FU_PIPELINED},                              \
+        },                                                                                          \
+            {L1I_SIZE, L1I_ASSOC, L1I_LINE, L1I_LATENCY, L1I_POLICY},                               \
+            {L1D_SIZE, L1D_ASSOC, L1D_LINE, L1D_LATENCY, L1D_POLICY},                               \
+            {L2_SIZE, L2_ASSOC, L2_LINE, L2_LATENCY, L2_POLICY}, MEMORY_LATENCY,                    \
+    }
+
+// CONFIG(cpu, field) reads a parameter; with FIXED_CONFIG the compiler
+// folds it to a constant so loops unroll and modulo becomes a mask
+#ifdef FIXED_CONFIG
+static const CPUConfig fixed_config = DEFAULT_CONFIG;
+#define CONFIG(cpu, field) (fixed_config.field)
+#else
+#define CONFIG(cpu, field) ((cpu)->config.field)
+#endif
+
+void config_defaults(CPUConfig *config);
+
+int config_load(CPUConfig *config, const char *filename);
+
+int config_check(const CPUConfig *config);
+
+void config_write(const CPUConfig *config, FILE *fp);
+
+#endif
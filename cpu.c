@@ -15,301 +15,146 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "cpu.h"
-#include <regex.h>
+#include "parser.h"
+#include "image.h"
+#include "stream.h"
+#include "memory.h"
+#include "trace.h"
+#include "program.h"
+#include "scheduler.h"
+#include "fu.h"
+#include "rename.h"
+#include "lsq.h"
+#include "cache.h"
+#include "predictor.h"
+#include "functional.h"
+#include "checkpoint.h"
+#include <limits.h>
 #include <stdint.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
 
-// flags
-int camel_flag = FALSE;
-int flush_flag = FALSE;
-int simulation_count = 0;
-
-// BTB and PT arrays
-BTBEntry btb[BTB_SIZE];
-PTEntry pt[PT_SIZE];
-ReorderBuffer rob;
-ReservationStation rs;
-
-// maping from opcode to string
-char *instructions[] = {"mul", "add", "sub", "div", "ld", "st", "mull", "addl", "subl", "divl", "ldl", "stl", "set", "bez", "bgez", "blez", "bgtz", "bltz", "ret"};
-
-// regex to check the opcode
-char *instruction_id_regex = "(mul)|(add)|(sub)|(div)|(ld)|(st)|(mull)|(addl)|(subl)|(divl)|(ldl)|(stl)|(set)|(bez)|(bgez)|(blez)|(bgtz)|(bltz)|(ret)";
-
-regex_t instruction_id_regex_compiled;
-
-// specific regex to parse the instruction
-char *instruction_regex[] = {
-    "^[0-9]+ mul R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ add R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ sub R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ div R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ ld R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ st R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ mul R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ add R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ sub R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ div R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ ld R([0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ st R([0-9]+) R(-?[0-9]+)",
-    "^[0-9]+ set R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ bez R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ bgez R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ blez R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ bgtz R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ bltz R([0-9]+) #(-?[0-9]+)",
-    "^[0-9]+ ret"};
-
-regex_t instruction_regex_compiled[ARRLEN(instruction_regex)];
-
-// initialise regex parser for compiled instructions
-void initilize_parser()
-{
-    // compile the regex for instruction IDs
-    if (regcomp(&instruction_id_regex_compiled, instruction_id_regex, REG_EXTENDED))
-    {
-        printf("Could not compile regular expression.\n");
-        exit(EXIT_FAILURE);
-    };
-
-    // loop through all instructions and compile their regexes
-    for (int i = 0; i < ARRLEN(instruction_regex); i++)
-    {
-        // compile the regex for the current instruction
-        if (regcomp(&instruction_regex_compiled[i], instruction_regex[i], REG_EXTENDED))
-        {
-            printf("Could not compile regular expression.\n");
-            exit(EXIT_FAILURE);
-        };
-    }
-}
-
-// Load instructions from the specified file
-Instruction *load_instructions(char *filename, int *size)
+CPU *CPU_init()
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int mem_size = 0;
-    int curr_instr = 0;
-    Instruction *code_memory;
-
-    if (!filename)
-        exit(EXIT_FAILURE);
-
-    fp = fopen(filename, "r");
-    if (!fp)
-        exit(EXIT_FAILURE);
-
-    while ((nread = getline(&line, &len, fp)) != -1)
-    {
-        mem_size++;
-    }
-
-    *size = mem_size;
-    if (!mem_size)
+    CPU *cpu = malloc(sizeof(*cpu));
+    if (!cpu)
     {
-        fclose(fp);
-        exit(EXIT_FAILURE);
+        return NULL;
     }
 
-    code_memory = calloc(mem_size, sizeof(Instruction));
-    if (!code_memory)
-    {
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
+    /* Create register files */
+    cpu->regs = create_registers(REG_COUNT);
 
-    rewind(fp);
+    cpu->regs_copy = create_registers(REG_COUNT);
 
-    while ((nread = getline(&line, &len, fp)) != -1)
-    {
-        if (line[nread - 1] == '\n')
-        {
-            line[nread - 1] = '\0';
-        }
-        parse_instructions(&code_memory[curr_instr], line, curr_instr);
-        curr_instr++;
-    }
+    cpu->program = NULL;
+    cpu->image = NULL;
+    cpu->shared_program = FALSE;
+    cpu->stream = NULL;
+    cpu->stream_window = 0;
+    cpu->memory = NULL;
+    cpu->memory_file = "memory_map.txt";
+    cpu->dump_file = NULL;
+    cpu->trace = trace_create();
+    // reported for a job that fails before it runs
+    cpu->clockCycle = 0;
+    cpu->simulation_count = 0;
+    cpu->stalled_cycles = 0;
+    cpu->program_error = FALSE;
+    cpu->max_cycles = 0;
+    config_defaults(&cpu->config);
+    cpu->rob.entries = NULL;
+    memset(&cpu->rs, 0, sizeof(cpu->rs));
+    cpu->rename = NULL;
+    cpu->lsq = NULL;
+    cpu->l1i = NULL;
+    cpu->l1d = NULL;
+    cpu->l2 = NULL;
+    cpu->fetch.uop = NULL;
+    cpu->fu_pool = NULL;
+    cpu->predictor = NULL;
+    cpu->functional = NULL;
+    cpu->uops = NULL;
+    cpu->uop_count = 0;
+    cpu->completed = NULL;
+    cpu->host_ns = 0;
+    cpu->host_cycles = 0;
+    cpu->fast_forward = 0;
+    cpu->warm = FALSE;
+    cpu->fast_forwarded = 0;
+    cpu->fast_forward_ns = 0;
+    cpu->checkpoint_file = NULL;
+    cpu->checkpoint_cycle = 0;
+    cpu->restore_file = NULL;
+    cpu->max_instructions = 0;
+    cpu->measure_from = 0;
+    cpu->measure_cycle = -1;
+    cpu->measure_count = 0;
 
-    free(line);
-    fclose(fp);
-    return code_memory;
+    return cpu;
 }
 
-// parse the given instructions
-void parse_instructions(Instruction *instr, char *line, int no)
+// allocate the structures sized by cpu->config
+int CPU_alloc_structures(CPU *cpu)
 {
-    strcpy(instr->instruction, line);
-    instr->instruction[strlen(line)] = '\0';
-    instr->instruction_no = no;
-
-    char *cursor = line;
-    regmatch_t match[1];
-    int reg_compile;
-
-    // compile the line with regular expressions
-    reg_compile = regexec(&instruction_id_regex_compiled, cursor, 1, match, 0);
-
-    if (reg_compile == REG_NOMATCH)
+    if (config_check(&cpu->config))
     {
-        printf("Could not parse instruction %d: %s\n", no, line);
-        char error_message[100];
-        regerror(reg_compile, &instruction_id_regex_compiled, error_message, sizeof(error_message));
-        printf("regexec failed: %s at position %d\n", error_message, (int)match[0].rm_so);
-        exit(EXIT_FAILURE);
+        return -1;
     }
-
-    char cursorCopy[strlen(cursor) + 1];
-    strcpy(cursorCopy, cursor);
-    cursorCopy[match[0].rm_eo] = 0;
-
-    // remove opcode from the string
-    memmove(cursorCopy, cursorCopy + 5, strlen(cursorCopy) - 5 + 1);
-    int has_register = has_two_R_letters(cursor, cursorCopy);
-
-    // get opcode index
-    instr->opcode = getIndex(instructions, ARRLEN(instructions), cursorCopy, has_register);
-
-    int group;
-    int maxGroups = 4;
-    int operands[3] = {0};
-    regmatch_t tokens[maxGroups];
-
-    if (regexec(&instruction_regex_compiled[instr->opcode], cursor, 4, tokens, 0))
+    free(cpu->rob.entries);
+    free(cpu->uops);
+    free(cpu->completed);
+    free(cpu->fetch.uop);
+    cache_destroy(cpu->l1i);
+    cache_destroy(cpu->l1d);
+    cache_destroy(cpu->l2);
+    cpu->l1i = cpu->l1d = cpu->l2 = NULL;
+    if (CONFIG(cpu, l2.size))
     {
-        printf("Could not parse instruction [%d: %s] of type [%d%s]\n", no, line, instr->opcode, cursorCopy + match[0].rm_so);
-        exit(EXIT_FAILURE);
-    }
-
-    for (group = 1; group < 4; group++)
-    {
-        if (tokens[group].rm_so == (size_t)-1)
-            break; // No more groups
-
-        char cursorCopy[strlen(cursor) + 1];
-        strcpy(cursorCopy, cursor);
-        cursorCopy[tokens[group].rm_eo] = 0;
-        operands[group - 1] = atoi(cursorCopy + tokens[group].rm_so);
-        // printf("Group %u: [%2u-%2u]: %s\n", group, tokens[group].rm_so, tokens[group].rm_eo, cursorCopy + tokens[group].rm_so);
-    }
-
-    switch (instr->opcode)
-    {
-        case MUL:
-        case ADD:
-        case SUB:
-        case DIV:
-            instr->rd = operands[0];
-            instr->rs1 = operands[1];
-            instr->op1 = operands[2];
-            break;
-        case MULL:
-        case ADDL:
-        case SUBL:
-        case DIVL:
-            instr->rd = operands[0];
-            instr->rs1 = operands[1];
-            instr->rs2 = operands[2];
-            break;
-        case SET:
-        case LD:
-        case ST:
-        case BEZ:
-        case BGEZ:
-        case BLEZ:
-        case BGTZ:
-        case BLTZ:
-            instr->rd = operands[0];
-            instr->op1 = operands[1];
-            break;
-        case LDL:
-        case STL:
-            instr->rd = operands[0];
-            instr->rs1 = operands[1];
-            break;
-    }
-}
-
-// check if the instruction has two R's
-int has_two_R_letters(char *str, char *code)
-{
-    int count = 0;
-    // Iterate through the string and count the number of 'R' letters.
-    // If two 'R' letters are found, return TRUE.
-    if (strcmp(code, "st") == 0 || strcmp(code, "ld") == 0)
-    {
-        for (int i = 0; str[i] != '\0'; i++)
+        cpu->l2 = cache_create("L2", &CONFIG(cpu, l2), NULL, CONFIG(cpu, memory_latency));
+        if (!cpu->l2)
         {
-            if (str[i] == 'R')
-            {
-                count++;
-                if (count == 2)
-                {
-                    return TRUE;
-                }
-            }
+            return -1;
         }
     }
-    else
+    if (CONFIG(cpu, l1i.size))
     {
-        for (int i = 0; str[i] != '\0'; i++)
+        cpu->l1i = cache_create("L1I", &CONFIG(cpu, l1i), cpu->l2, CONFIG(cpu, memory_latency));
+        if (!cpu->l1i)
         {
-            if (str[i] == 'R')
-            {
-                count++;
-                if (count == 3)
-                {
-                    return TRUE;
-                }
-            }
+            return -1;
         }
     }
-    // If the string does not contain two 'R' letters, return FALSE.
-    return FALSE;
-}
-
-int getIndex(char **arr, int len, char *inst, int has_register)
-{
-    // If the instruction requires a register, append 'l' to the instruction string.
-    // Note that the 'l' character is only appended to the instruction string if the instruction
-    // is not "set" or "ret", as these two instructions do not require a register.
-    if (has_register)
+    if (CONFIG(cpu, l1d.size))
     {
-        if (strcmp(inst, "set") != 0 && strcmp(inst, "ret") != 0)
+        cpu->l1d = cache_create("L1D", &CONFIG(cpu, l1d), cpu->l2, CONFIG(cpu, memory_latency));
+        if (!cpu->l1d)
         {
-            strcat(inst, "l");
+            return -1;
         }
     }
-
-    // printf("%s\n", inst);
-
-    for (int i = 0; i < len; i++)
+    cpu->fetch.size = CONFIG(cpu, fetch_buffer) ? CONFIG(cpu, fetch_buffer) : CONFIG(cpu, fetch_width);
+    cpu->fetch.uop = malloc(sizeof(int) * cpu->fetch.size);
+    // every uop in the ROB plus a full front end, rounded up to a power of
+    // two; the commit_width spare slots keep a retired group readable for
+    // the trace until the end of the cycle
+    cpu->uop_count = 1;
+    while (cpu->uop_count < CONFIG(cpu, rob_size) + cpu->fetch.size + 3 * CONFIG(cpu, fetch_width) +
+                                CONFIG(cpu, commit_width))
     {
-        // printf("%s, %d\n", inst, strcmp(inst, arr[i]));
-        if (strcmp(arr[i], inst) == 0)
-        {
-            return i;
-        }
+        cpu->uop_count <<= 1;
     }
-
-    return -1;
-}
-
-CPU *CPU_init()
-{
-    CPU *cpu = malloc(sizeof(*cpu));
-    if (!cpu)
+    cpu->uops = calloc(cpu->uop_count, sizeof(Stage));
+    cpu->completed = malloc(sizeof(int) * cpu->uop_count);
+    cpu->rob.entries = malloc(sizeof(ROBEntry) * CONFIG(cpu, rob_size));
+    if (rename_alloc(cpu) || lsq_alloc(cpu) || RS_Alloc(cpu) || fu_alloc(cpu) || predictor_alloc(cpu) ||
+        functional_alloc(cpu) || !cpu->uops || !cpu->completed || !cpu->fetch.uop || !cpu->rob.entries)
     {
-        return NULL;
+        return -1;
     }
-
-    /* Create register files */
-    cpu->regs = create_registers(REG_COUNT);
-
-    cpu->regs_copy = create_registers(REG_COUNT);
-
-    return cpu;
+    return 0;
 }
 
 int *create_memory(int size)
@@ -325,424 +170,770 @@ int *create_memory(int size)
 
 // =================== STAGES ======================================
 
+// Retire Stage: commit up to commit_width completed instructions from the
+// ROB head in program order. Registers and stores become architectural
+// here and branches train the predictor; a mispredicted branch already
+// squashed what came after it when it wrote back.
 void retire_stage(CPU *cpu)
 {
-    if (cpu->retire_1.occupied){
-        cpu->regs[rob.entries[cpu->retire_1.dest_value].destinationReg].value = rob.entries[cpu->retire_1.dest_value].result;
-        cpu->regs[rob.entries[cpu->retire_1.dest_value].destinationReg].tag = -1;
-        cpu->regs[rob.entries[cpu->retire_1.dest_value].destinationReg].status = TRUE; 
-        rob.entries[cpu->retire_1.dest_value].destinationReg = -1;
-        rob.entries[cpu->retire_1.dest_value].result = -1;
-        rob.entries[cpu->retire_1.dest_value].completed = FALSE;
-    }
-}
+    int width = CONFIG(cpu, commit_width);
 
-// Writeback Stage
-static int writeback_stage(CPU *cpu)
-{
-    if (cpu->writeback_1.occupied)
-    {
-        Instruction *inst = cpu->writeback_1.inst;
-        simulation_count += 1;
-        switch (inst->opcode)
-        {
-            case MUL:
-            case ADD:
-            case SUB:
-            case DIV:
-            case MULL:
-            case ADDL:
-            case SUBL:
-            case DIVL:
-            case SET:
-            case LD:
-            case LDL:
-                rob.entries[cpu->writeback_1.dest_value].result = cpu->writeback_1.result;
-                rob.entries[cpu->writeback_1.dest_value].completed = TRUE;
-                break;
-            case RET:
-                return TRUE;
-                break;
-        }
-        cpu->retire_1 = cpu->writeback_1;
-        cpu->writeback_1.occupied = FALSE;
-    }
-    return 0;
-}
-
-// Memory 2 Stage
-void memory2_stage(CPU *cpu)
-{
-    if (cpu->mem2.occupied)
+    cpu->retire.count = 0;
+    while (cpu->retire.count < width && !ROB_IsEmpty(cpu) && cpu->rob.entries[cpu->rob.head].completed)
     {
-        Instruction *inst = cpu->mem2.inst;
-        Stage *s = &cpu->mem2;
-        switch (inst->opcode)
+        ROBEntry *e = &cpu->rob.entries[cpu->rob.head];
+        Stage *s = &cpu->uops[e->uop];
+        if (e->exception)
         {
-        case LD:
-        case LDL:
-            // changed memeory address index
-            cpu->mem2.result = cpu->data_mem[(cpu->mem2.addr)/4];
+            if (s->fu == FU_DIV)
+                printf("\n\nFloating point exception occured..\n");
+            else
+                printf("Error: Address %x exceeds maximum memory size of %d\n", s->addr, MEMORY_SIZE);
+            cpu->fault = TRUE;
+            cpu->halt_flag.halt = TRUE;
+            break;
+        }
+        if (s->replay)
+        {
+            // memory-order violation, the load and all after it run again
+            TRACE_EVENT(cpu->trace, TRACE_ROB, TRACE_EV_REPLAY, cpu->clockCycle, s->opcode, s->pc, s->addr);
+            rename_flush(cpu);
+            predictor_flush(cpu);
+            cpu->frontend.redirects[REDIRECT_REPLAY]++;
+            cpu->frontend.squashed[REDIRECT_REPLAY] += cpu->uop_tail - cpu->uop_head;
+            cpu->pc = s->pc;
+            cpu->flush = SLOT_FLUSH;
+            path_refetch(cpu, s);
+            flushStages(cpu);
             break;
+        }
+        TRACE_EVENT(cpu->trace, TRACE_ROB, TRACE_EV_RETIRE, cpu->clockCycle, s->opcode, s->pc, e->ROBid);
+        assert(s->seq == cpu->uop_head);
+
+        if (IS_BRANCH(s->opcode))
+        {
+            updateBranchPredictor(cpu, e->uop, s->result);
+        }
+        rename_commit(cpu, s);
+        lsq_commit(cpu, s);
+        if (e->destinationReg != NO_UOP)
+        {
+            Register *r = &cpu->regs[e->destinationReg];
+            r->value = e->result;
+            r->status = TRUE;
+        }
+        switch (s->opcode)
+        {
         case ST:
         case STL:
-            cpu->data_mem[s->dest_value/4] = s->src1_value;
+            cpu->data_mem[s->addr/4] = s->src1_value;
+            if (cpu->l1d)
+            {
+                cache_write(cpu->l1d, s->addr);
+            }
+            if (s->addr/4 >= cpu->memory_size)
+            {
+                cpu->memory_size = s->addr/4 + 1;
+            }
+            break;
+        case RET:
+            cpu->halt_flag.halt = TRUE;
             break;
         }
-        switch (inst->opcode)
+
+        e->destinationReg = -1;
+        e->uop = NO_UOP;
+        cpu->rob.head = (cpu->rob.head + 1) % CONFIG(cpu, rob_size);
+        cpu->rob.count--;
+        cpu->uop_head++;
+        cpu->retire.uop[cpu->retire.count++] = s->seq & (cpu->uop_count - 1);
+        cpu->simulation_count++;
+
+        if (s->opcode == RET)
         {
-        case LD:
-        case LDL:
-            cpu->memory_bubble.reg = inst->rd;
-            cpu->memory_bubble.val = cpu->mem2.result;
-            cpu->memory_bubble.valid = TRUE;
             break;
         }
     }
+    cpu->commit.groups[cpu->retire.count]++;
 }
 
-// Memory 1 Stage
-void memory1_stage(CPU *cpu)
+// a functional unit finished uop, queue it for a writeback port by age
+void complete_uop(CPU *cpu, int uop)
 {
-    Instruction *inst = cpu->mem1.inst;
-    Stage *s = &cpu->mem1;
-    if (cpu->mem1.occupied)
+    Stage *s = &cpu->uops[uop];
+    unsigned int age = s->seq - cpu->uop_head;
+    int i = cpu->completed_count++;
+
+    s->done_cycle = cpu->clockCycle;
+    while (i > 0 && cpu->uops[cpu->completed[i - 1]].seq - cpu->uop_head > age)
     {
-        switch (inst->opcode)
-        {
-        case LD:
-        case LDL:
-        case ST:
-        case STL:
-            s->addr = s->src1_value;
-            break;
-        }
+        cpu->completed[i] = cpu->completed[i - 1];
+        i--;
     }
+    cpu->completed[i] = uop;
 }
 
-// Branch Stage
-void branch_stage(CPU *cpu) {
-    Instruction *inst = cpu->branch.inst;
-    Stage *s = &cpu->branch;
-    int actual_outcome = 0;
-    int addr;
+// Writeback Stage: the oldest writeback_width completed uops get a port and
+// broadcast their result to the ROB and the waiting reservation stations.
+// A branch that went against its prediction squashes everything younger.
+void writeback_stage(CPU *cpu)
+{
+    WritebackStats *ws = &cpu->writeback_stats;
+    Latch *ports = &cpu->writeback;
+    int width = CONFIG(cpu, writeback_width);
 
-    if(cpu->branch.occupied)
+    ports->count = 0;
+    while (ports->count < width && ports->count < cpu->completed_count)
     {
-        switch (inst->opcode)
+        int id = cpu->completed[ports->count];
+        Stage *s = &cpu->uops[id];
+        long delay = cpu->clockCycle - s->done_cycle - 1;
+        TRACE_EVENT(cpu->trace, TRACE_ROB, TRACE_EV_WRITEBACK, cpu->clockCycle, s->opcode, s->pc, s->result);
+
+        if (delay > 0)
         {
-        case BGEZ:
-            if(s->src2_value >= 0){
-                actual_outcome = 1;
-            }
-            updateBranchPredictor(cpu, s->src1_value, actual_outcome);
-            break;
-        case BLEZ:
-            if(s->src2_value <= 0){
-                actual_outcome = 1;
-            }
-            updateBranchPredictor(cpu, s->src1_value, actual_outcome);
-            break;
-        case BGTZ:
-            if(s->src2_value > 0){
-                actual_outcome = 1;
-            }
-            updateBranchPredictor(cpu, s->src1_value, actual_outcome);
-            break;
-        case BLTZ:
-            if(s->src2_value < 0){
-                actual_outcome = 1;
-            }
-            updateBranchPredictor(cpu, s->src1_value, actual_outcome);
-            break;
-        case BEZ:
-            if(s->src2_value == 0){
-                actual_outcome = 1;
+            ws->delayed++;
+            ws->delay_cycles += delay;
+            if (delay > ws->max_delay)
+            {
+                ws->max_delay = delay;
             }
-            updateBranchPredictor(cpu, s->src1_value, actual_outcome);
-            break;
         }
+        ROB_Update(cpu, s->rob, s->result);
+        cpu->rob.entries[s->rob].exception = s->exception;
+        cpu->rob.entries[s->rob].completed = TRUE;
+        if (s->dest != NO_UOP)
+        {
+            rename_write(cpu, s->preg, s->result);
+            RS_Wakeup(cpu, s->preg, s->result);
+        }
+        ports->uop[ports->count++] = id;
+        if (IS_BRANCH(s->opcode) && s->result != s->predicted_taken)
+        {
+            squashYounger(cpu, s);
+        }
+    }
+    cpu->completed_count -= ports->count;
+    for (int i = 0; i < cpu->completed_count; i++)
+    {
+        cpu->completed[i] = cpu->completed[i + ports->count];
     }
+    ws->groups[ports->count]++;
 }
 
-// flush or squash all wrong fetched instructions
+// mispredicted branch wrote back: every uop younger than it leaves the
+// ROB, RS, functional units and LSQ, the rename map and history go back to
+// the branch, and fetch restarts on the right path next cycle; older uops
+// carry on
+void squashYounger(CPU *cpu, Stage *branch)
+{
+    FrontendStats *fs = &cpu->frontend;
+    unsigned int age = branch->seq - cpu->uop_head;
+    int kept = 0;
+
+    fs->redirects[REDIRECT_MISPREDICT]++;
+    fs->squashed[REDIRECT_MISPREDICT] += cpu->uop_tail - branch->seq - 1;
+    fs->resolve_cycles += cpu->clockCycle - branch->fetch_cycle;
+    for (int rob = (branch->rob + 1) % CONFIG(cpu, rob_size); rob != cpu->rob.tail;
+         rob = (rob + 1) % CONFIG(cpu, rob_size))
+    {
+        cpu->rob.entries[rob].uop = NO_UOP;
+        cpu->rob.entries[rob].destinationReg = -1;
+    }
+    cpu->rob.tail = (branch->rob + 1) % CONFIG(cpu, rob_size);
+    cpu->rob.count = (branch->rob - cpu->rob.head + CONFIG(cpu, rob_size)) % CONFIG(cpu, rob_size) + 1;
+    RS_Squash(cpu, age);
+    fu_squash(cpu, age);
+    lsq_squash(cpu, age);
+    for (int i = 0; i < cpu->completed_count; i++)
+    {
+        if (cpu->uops[cpu->completed[i]].seq - cpu->uop_head <= age)
+        {
+            cpu->completed[kept++] = cpu->completed[i];
+        }
+    }
+    cpu->completed_count = kept;
+    rename_recover(cpu, branch);
+    predictor_recover(cpu, branch, branch->result);
+    path_redirect(cpu, branch, branch->result ? branch->imm / 4 : branch->pc + 1);
+
+    // the front end holds nothing older than a dispatched branch
+    cpu->read_registers.count = 0;
+    cpu->analyze.count = 0;
+    cpu->decode.count = 0;
+    cpu->fetch.head = cpu->fetch.count = 0;
+    cpu->fetch_halted = FALSE;
+    cpu->fetch_line = -1;
+    cpu->uop_tail = branch->seq + 1;
+    cpu->refill_seq = cpu->uop_tail;
+    cpu->refill_cycle = cpu->clockCycle;
+    cpu->pc = branch->result ? branch->imm / 4 : branch->pc + 1;
+    cpu->flush = SLOT_FLUSH;
+}
+
+// squash everything in flight, used for a replay at commit (and on an
+// empty pipeline at reset) so all that remains is older and committed; the
+// rename map is restored separately
 void flushStages(CPU *cpu){
-    cpu->div.occupied = FALSE;
-    cpu->mul.occupied = FALSE;
-    cpu->add.occupied = FALSE;
-    cpu->read_registers.occupied = FALSE;
-    cpu->analyze.occupied = FALSE;
-    cpu->decode.occupied = FALSE;
-    cpu->fetch.occupied = FALSE;
+    cpu->uop_tail = cpu->uop_head;
+    cpu->rob.tail = cpu->rob.head;
+    cpu->rob.count = 0;
+    RS_Init(cpu);
+    lsq_reset(cpu);
+    cpu->issue.count = 0;
+    fu_reset(cpu);
+    cpu->completed_count = 0;
+    cpu->writeback.count = 0;
+    cpu->read_registers.count = 0;
+    cpu->analyze.count = 0;
+    cpu->decode.count = 0;
+    cpu->fetch.head = cpu->fetch.count = 0;
+    cpu->fetch_halted = FALSE;
+    cpu->fetch_line = -1;
+    cpu->fetch_ready = 0;
+    cpu->refill_cycle = -1;
     cpu->halt_flag.halt = FALSE;
     cpu->halt_flag.end_halt = FALSE;
-    for (int i = 0; i < REG_COUNT; i++)
-    {
-        cpu->regs[i].is_writing = FALSE;
-    }
 }
 
-// Div Stage
-void div_stage(CPU *cpu)
+// Execute: the result of uop, computed when it issues and delivered by
+// the functional unit after its latency; returns the cycles a load spends
+// in the data cache on top of that
+int execute_uop(CPU *cpu, Stage *s)
 {
-    Instruction *inst = cpu->div.inst;
-    Stage *s = &cpu->div;
-    if (cpu->div.occupied)
+    int a = s->src1_value;
+    int b = s->src2_value;
+    int extra = 0;
+
+    cpu->wrong_path.executed += s->wrong_path;
+    switch (s->opcode)
     {
-        switch (inst->opcode)
+    case ADD:
+    case ADDL:
+        s->result = a + b;
+        break;
+    case SUB:
+    case SUBL:
+        s->result = a - b;
+        break;
+    case SET:
+        s->result = a;
+        break;
+    case MUL:
+    case MULL:
+        s->result = a * b;
+        break;
+    case DIV:
+    case DIVL:
+        if (b == 0)
         {
-        case DIV:
-        case DIVL:
-            if(s->src2_value == 0){
-                printf("\n\nFloating point exception occured..\n");
-                exit(1);
-            }else{
-                s->result = s->src1_value / s->src2_value;
-            }
-            cpu->div_bubble.reg = inst->rd;
-            cpu->div_bubble.val = s->result;
-            cpu->div_bubble.valid = TRUE;
-            break;
+            // possibly on a wrong path, raised if it commits
+            s->exception = true;
+            s->result = 0;
         }
+        else
+        {
+            s->result = a / b;
+        }
+        break;
+    case LD:
+    case LDL:
+    case ST:
+    case STL:
+        // loads carry the address in src1, stores in src2
+        s->addr = (s->opcode == ST || s->opcode == STL) ? b : a;
+        // a wrong-path address must not reach data_mem, it faults if committed
+        if (s->addr < 0 || s->addr/4 >= MEMORY_SIZE)
+        {
+            s->exception = true;
+        }
+        else if (s->opcode == LD || s->opcode == LDL)
+        {
+            cpu->wrong_path.loads += s->wrong_path;
+            s->result = lsq_load(cpu, s, &extra);
+        }
+        else
+        {
+            cpu->wrong_path.stores += s->wrong_path;
+            lsq_store(cpu, s);
+        }
+        break;
+    case BEZ:
+        s->result = a == 0;
+        break;
+    case BGEZ:
+        s->result = a >= 0;
+        break;
+    case BLEZ:
+        s->result = a <= 0;
+        break;
+    case BGTZ:
+        s->result = a > 0;
+        break;
+    case BLTZ:
+        s->result = a < 0;
+        break;
     }
+    return extra;
 }
 
-// Mul Stage
-void mul_stage(CPU *cpu)
+// Issue Stage: up to issue_width of the oldest ready uops, each to a free
+// unit of its class
+void issue_stage(CPU *cpu)
 {
-    Instruction *inst = cpu->mul.inst;
-    Stage *s = &cpu->mul;
-    if (cpu->mul.occupied)
+    Latch *latch = &cpu->issue;
+    FUStats *stats = cpu->fu_pool->stats;
+    int width = CONFIG(cpu, issue_width);
+    int candidate[FU_CLASSES];
+    int unit[FU_CLASSES];
+
+    for (int fu = 0; fu < FU_CLASSES; fu++)
     {
-        switch (inst->opcode)
+        candidate[fu] = RS_Select(cpu, fu);
+        unit[fu] = candidate[fu] == NO_UOP ? NO_UOP : fu_unit(cpu, fu);
+        if (candidate[fu] != NO_UOP && unit[fu] == NO_UOP)
+        {
+            stats[fu].structural_stalls++;
+            candidate[fu] = NO_UOP;
+        }
+    }
+    latch->count = 0;
+    while (latch->count < width)
+    {
+        int best = NO_UOP;
+        for (int fu = 0; fu < FU_CLASSES; fu++)
+        {
+            if (candidate[fu] != NO_UOP &&
+                (best == NO_UOP || cpu->uops[cpu->rs.entries[candidate[fu]]].seq - cpu->uop_head <
+                                       cpu->uops[cpu->rs.entries[candidate[best]]].seq - cpu->uop_head))
+            {
+                best = fu;
+            }
+        }
+        if (best == NO_UOP)
         {
-        case MUL:
-        case MULL:
-            s->result = s->src1_value * s->src2_value;
-            s->result = s->src1_value * s->src2_value;
-            cpu->mul_bubble.reg = inst->rd;
-            cpu->mul_bubble.val = s->result;
-            cpu->mul_bubble.valid = TRUE;
             break;
         }
+        int id = cpu->rs.entries[candidate[best]];
+        Stage *s = &cpu->uops[id];
+        TRACE_EVENT(cpu->trace, TRACE_RS, TRACE_EV_ISSUE, cpu->clockCycle, s->opcode, s->pc, candidate[best]);
+        RS_Clear(cpu, candidate[best]);
+        fu_start(cpu, unit[best], id, execute_uop(cpu, s));
+        latch->uop[latch->count++] = id;
+
+        // next oldest of the class, if another unit is free
+        candidate[best] = RS_Select(cpu, best);
+        if (candidate[best] != NO_UOP && (unit[best] = fu_unit(cpu, best)) == NO_UOP)
+        {
+            stats[best].structural_stalls++;
+            candidate[best] = NO_UOP;
+        }
     }
+    for (int fu = 0; fu < FU_CLASSES; fu++)
+    {
+        cpu->issue_stats.ready_left += candidate[fu] != NO_UOP;
+    }
+    cpu->issue_stats.groups[latch->count]++;
 }
 
-// Add Stage
-void add_stage(CPU *cpu)
+// Read Register Stage: rename and dispatch up to fetch_width uops in order,
+// each takes a ROB entry, all but ret a reservation station, a destination
+// a physical register, a branch a rename checkpoint and a load or store an
+// entry in its queue
+void read_registers_stage(CPU *cpu)
 {
-    Stage *s = &cpu->add;
-    if (cpu->add.occupied)
+    Latch *latch = &cpu->read_registers;
+    long *slots = cpu->frontend.dispatch;
+    int width = CONFIG(cpu, fetch_width);
+    int done = 0;
+
+    while (done < latch->count)
     {
-        switch (s->opcode)
+        int id = latch->uop[done];
+        Stage *s = &cpu->uops[id];
+        if (ROB_IsFull(cpu))
         {
-        case ADD:
-        case ADDL:
-            s->result = s->src1_value + s->src2_value;
+            slots[SLOT_ROB] += latch->count - done;
+            cpu->commit.rob_full_cycles++;
             break;
-        case SUB:
-        case SUBL:
-            s->result = s->src1_value - s->src2_value;
+        }
+        if (s->opcode != RET && RS_IsFull(cpu))
+        {
+            slots[SLOT_RS] += latch->count - done;
             break;
-        case SET:
-            s->result = s->src1_value;
+        }
+        int lost = rename_check(cpu, s);
+        if (lost == SLOT_USED)
+        {
+            lost = lsq_check(cpu, s);
+        }
+        if (lost != SLOT_USED)
+        {
+            slots[lost] += latch->count - done;
             break;
         }
+        rename_uop(cpu, s);
+        if (s->seq == cpu->refill_seq && cpu->refill_cycle >= 0)
+        {
+            cpu->frontend.refill_cycles += cpu->clockCycle - cpu->refill_cycle;
+            cpu->frontend.refills++;
+            cpu->refill_cycle = -1;
+        }
+        s->rob = ROB_Enqueue(cpu, id);
+        lsq_dispatch(cpu, s);
+        if (s->opcode != RET)
+        {
+            RS_Enqueue(cpu, id);
+        }
+        else
+        {
+            // nothing to execute, ready to commit
+            cpu->rob.entries[s->rob].completed = TRUE;
+        }
+        done++;
+    }
+    slots[SLOT_USED] += done;
+    slots[SLOT_EMPTY] += width - latch->count;
+    rename_sample(cpu);
+
+    latch->count -= done;
+    for (int i = 0; i < latch->count; i++)
+    {
+        latch->uop[i] = latch->uop[i + done];
     }
 }
 
+// Analyze Stage (Empty)
+void analyze_stage(CPU *cpu) {}
 
-void issue_stage(CPU *cpu, ReorderBuffer *rbo)
+// predicted-taken branch s missed in the BTB so fetch carried on past it;
+// decode has the target, everything fetched after s is dropped
+static void decode_redirect(CPU *cpu, Stage *s)
 {
-    Instruction *inst = cpu->read_registers.inst;
-    Stage *s = &cpu->read_registers;
+    FrontendStats *fs = &cpu->frontend;
+
+    fs->redirects[REDIRECT_DECODE]++;
+    fs->squashed[REDIRECT_DECODE] += cpu->uop_tail - s->seq - 1;
+    cpu->uop_tail = s->seq + 1;
+    cpu->fetch.head = cpu->fetch.count = 0;
+    cpu->fetch_halted = FALSE;
+    cpu->fetch_line = -1;
+    cpu->pc = s->imm / 4;
+    cpu->flush = SLOT_DECODE;
+    predictor_recover(cpu, s, true);
+    path_redirect(cpu, s, cpu->pc);
 }
 
-// Read Register Stage
-void read_registers_stage(CPU *cpu)
+// Decode Stage: architectural destination and sources, immediates go
+// straight into the source values; a taken branch fetch had no target for
+// redirects the front end
+void decode_stage(CPU *cpu)
 {
-    Instruction *inst = cpu->read_registers.inst;
-    Stage *s = &cpu->read_registers;
-    if (cpu->read_registers.occupied)
+    for (int i = 0; i < cpu->decode.count; i++)
     {
-        switch (inst->opcode)
+        Stage *s = &cpu->uops[cpu->decode.uop[i]];
+        s->dest = s->src1_reg = s->src2_reg = NO_UOP;
+        switch (s->opcode)
         {
         case ADDL:
         case SUBL:
         case MULL:
         case DIVL:
-            s->dest_value = ROB_Enqueue(cpu, s->dest_value);
-            // cpu->decode.dest_value = inst->rd;
-            // cpu->decode.src1_value = inst->rs1;
-            // cpu->decode.src2_value = inst->rs2;
+            s->dest = s->rd;
+            s->src1_reg = s->rs1;
+            s->src2_reg = s->rs2;
             break;
         case ADD:
         case SUB:
         case MUL:
         case DIV:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->rs1;
-            cpu->decode.src2_value = inst->op1;
+            s->dest = s->rd;
+            s->src1_reg = s->rs1;
+            s->src2_value = s->imm;
             break;
         case LD:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->op1;
+            s->dest = s->rd;
+            s->src1_value = s->imm;
             break;
         case LDL:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->rs1;
+            s->dest = s->rd;
+            s->src1_reg = s->rs1;
             break;
         case ST:
-            cpu->decode.dest_value = inst->op1;
-            cpu->decode.src1_value = inst->rd;
+            // value in src1, address in src2
+            s->src1_reg = s->rd;
+            s->src2_value = s->imm;
             break;
         case STL:
-            cpu->decode.dest_value = inst->rs1;
-            cpu->decode.src1_value = inst->rd;
+            s->src1_reg = s->rd;
+            s->src2_reg = s->rs1;
             break;
         case SET:
-            s->dest_value = ROB_Enqueue(cpu, s->dest_value);
-            RS_Enqueue(cpu, s->inst->opcode, s->src1_value, s->src2_value, s->dest_value);
+            s->dest = s->rd;
+            s->src1_value = s->imm;
             break;
         case BEZ:
         case BGEZ:
         case BLEZ:
         case BGTZ:
         case BLTZ:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->op1;
+            // tested register in src1, the target stays in imm
+            s->src1_reg = s->rd;
+            if (s->predicted_taken && !s->btb_hit)
+            {
+                decode_redirect(cpu, s);
+                cpu->decode.count = i + 1;
+            }
             break;
         }
     }
 }
 
-// Analyze Stage (Empty)
-void analyze_stage(CPU *cpu) {}
+// fill uop with the instruction at pc, returns -1 past the end of the program
+int fetch_instruction(CPU *cpu, int pc, Stage *uop)
+{
+    Program *program = cpu->program;
+    Instruction inst;
 
-// Decode Stage
-void decode_stage(CPU *cpu)
+    if (program)
+    {
+        if (pc >= program->size)
+        {
+            return -1;
+        }
+        uop->opcode = program->opcode[pc];
+        uop->fu = program->fu[pc];
+        uop->rd = program->rd[pc];
+        uop->rs1 = program->rs1[pc];
+        uop->rs2 = program->rs2[pc];
+        uop->imm = program->imm[pc];
+    }
+    else
+    {
+        if (cpu->stream)
+        {
+            int status = stream_fetch(cpu->stream, pc, &inst);
+            if (status)
+            {
+                if (status == STREAM_ERROR)
+                {
+                    cpu->program_error = TRUE;
+                }
+                return -1;
+            }
+        }
+        else
+        {
+            if (pc >= cpu->code_size)
+            {
+                return -1;
+            }
+            decode_word(cpu->image->code[pc], pc, &inst);
+        }
+        uop->opcode = inst.opcode;
+        uop->fu = fu_class(inst.opcode);
+        uop->rd = inst.rd;
+        uop->rs1 = inst.rs1;
+        uop->rs2 = inst.rs2;
+        uop->imm = inst.op1;
+    }
+    uop->pc = pc;
+    uop->dest = uop->src1_reg = uop->src2_reg = NO_UOP;
+    uop->rob = uop->src1_tag = uop->src2_tag = NO_UOP;
+    uop->preg = uop->old_preg = uop->checkpoint = NO_UOP;
+    uop->src1_value = uop->src2_value = 0;
+    uop->result = uop->addr = 0;
+    uop->valid = uop->src1_ready = uop->src2_ready = false;
+    uop->predicted_taken = false;
+    uop->exception = false;
+    uop->replay = false;
+    return 0;
+}
+
+// display text of an in-flight instruction, only needed for tracing
+const char *instruction_text(CPU *cpu, Stage *uop, char *buffer, int size)
+{
+    Instruction inst;
+    const char *text;
+
+    if (cpu->program)
+    {
+        return program_text(cpu->program, uop->pc);
+    }
+    if (cpu->image && (text = image_symbol(cpu->image, uop->pc)))
+    {
+        return text;
+    }
+
+    // stripped images and streams carry no source text
+    inst.instruction_no = uop->pc;
+    inst.opcode = uop->opcode;
+    inst.rd = uop->rd;
+    inst.rs1 = uop->rs1;
+    inst.rs2 = uop->rs2;
+    inst.op1 = uop->imm;
+    disassemble(&inst, buffer, size);
+    return buffer;
+}
+
+// Fetch Stage: up to fetch_width instructions from one aligned fetch
+// block into the fetch buffer, the group ends after a predicted-taken
+// branch the BTB has a target for or at an instruction cache miss. A hit is
+// part of the stage, a miss holds fetch until the line arrives.
+void fetch_stage(CPU *cpu)
 {
-    if (cpu->decode.occupied)
+    FetchBuffer *buffer = &cpu->fetch;
+    long *slots = cpu->frontend.fetch;
+    int width = CONFIG(cpu, fetch_width);
+    int room = buffer->size - buffer->count;
+    int fetched = 0;
+    int lost = SLOT_USED;
+    int target;
+
+    if (cpu->flush)
+    {
+        // redirected this cycle, fetch resumes at the new pc next cycle and
+        // no longer waits for a line on the old path
+        slots[cpu->flush] += width;
+        cpu->flush = FALSE;
+        cpu->fetch_ready = 0;
+        cpu->frontend.fetch_groups[0]++;
+        return;
+    }
+    if (cpu->clockCycle < cpu->fetch_ready)
+    {
+        slots[SLOT_ICACHE] += width;
+        cpu->frontend.icache_stall_cycles++;
+        cpu->frontend.fetch_groups[0]++;
+        return;
+    }
+    if (room < width)
     {
-        Instruction *inst = cpu->decode.inst;
-        switch (inst->opcode)
+        slots[SLOT_STALL] += width - room;
+        width = room;
+    }
+
+    while (fetched < width)
+    {
+        if (cpu->fetch_halted)
         {
-        case ADDL:
-        case SUBL:
-        case MULL:
-        case DIVL:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->rs1;
-            cpu->decode.src2_value = inst->rs2;
-            break;
-        case ADD:
-        case SUB:
-        case MUL:
-        case DIV:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->rs1;
-            cpu->decode.src2_value = inst->op1;
-            break;
-        case LD:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->op1;
+            lost = SLOT_END;
             break;
-        case LDL:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->rs1;
-            break;
-        case ST:
-            cpu->decode.dest_value = inst->op1;
-            cpu->decode.src1_value = inst->rd;
-            break;
-        case STL:
-            cpu->decode.dest_value = inst->rs1;
-            cpu->decode.src1_value = inst->rd;
-            break;
-        case SET:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->op1;
+        }
+        if (cpu->uop_tail - cpu->uop_head == (unsigned int)cpu->uop_count)
+        {
+            lost = SLOT_POOL;
             break;
-        case BEZ:
-        case BGEZ:
-        case BLEZ:
-        case BGTZ:
-        case BLTZ:
-            cpu->decode.dest_value = inst->rd;
-            cpu->decode.src1_value = inst->op1;
+        }
+        if (cpu->functional->wrong_path && !CONFIG(cpu, wrong_path))
+        {
+            lost = SLOT_WRONG;
             break;
         }
-    }
-}
-
-// Fetch Stage
-void fetch_stage(CPU *cpu)
-{
-    if (!cpu->fetch.occupied)
-    {
-        if (cpu->pc >= cpu->code_size)
+        if (cpu->l1i && cpu->pc * 4 >> cpu->l1i->line_shift != cpu->fetch_line)
         {
-            // reached end of the code nothing to fetch
-            return;
+            int latency = cache_read(cpu->l1i, cpu->pc * 4);
+            cpu->wrong_path.icache_reads += cpu->functional->wrong_path;
+            cpu->fetch_line = cpu->pc * 4 >> cpu->l1i->line_shift;
+            if (latency > CONFIG(cpu, l1i.latency))
+            {
+                cpu->fetch_ready = cpu->clockCycle + latency - CONFIG(cpu, l1i.latency);
+                lost = SLOT_ICACHE;
+                break;
+            }
         }
-
-        if(cpu->flush){
-            return;
+        Stage *s = &cpu->uops[cpu->uop_tail & (cpu->uop_count - 1)];
+        if (fetch_instruction(cpu, cpu->pc, s))
+        {
+            // reached end of the code nothing to fetch, until a redirect
+            cpu->fetch_halted = TRUE;
+            lost = SLOT_END;
+            break;
         }
-
-        cpu->fetch.pc = cpu->pc;
-        cpu->fetch.inst = &cpu->code_mem[cpu->pc];
-
-        if(predictBranchOutcome(cpu->pc) && cpu->fetch.inst->opcode >= 13 && cpu->fetch.inst->opcode <= 17){
-            cpu->pc = cpu->fetch.inst->op1/4;
-        }else{
-            cpu->pc += 1;
+        s->seq = cpu->uop_tail++;
+        s->fetch_cycle = cpu->clockCycle;
+        path_fetch(cpu, s);
+        buffer->uop[(buffer->head + buffer->count++) % buffer->size] = s->seq & (cpu->uop_count - 1);
+        fetched++;
+        TRACE_EVENT(cpu->trace, TRACE_FETCH, TRACE_EV_FETCH, cpu->clockCycle, s->opcode, cpu->pc, 0);
+
+        if (s->opcode == RET)
+        {
+            cpu->fetch_halted = TRUE;
+        }
+        // predecode marks branches for the direction predictor, but only a
+        // BTB target takes fetch off the sequential path
+        if (IS_BRANCH(s->opcode) && predictBranchOutcome(cpu, s, &target) && s->btb_hit)
+        {
+            cpu->frontend.redirects[REDIRECT_BTB]++;
+            cpu->pc = target;
+            path_next(cpu, s, cpu->pc);
+            lost = SLOT_TAKEN;
+            break;
+        }
+        cpu->pc += 1;
+        path_next(cpu, s, cpu->pc);
+        if (cpu->pc % CONFIG(cpu, fetch_block) == 0)
+        {
+            lost = SLOT_BLOCK;
+            break;
         }
-        cpu->fetch.occupied = TRUE;
     }
+    slots[SLOT_USED] += fetched;
+    slots[lost] += width - fetched;
+    cpu->frontend.fetch_groups[fetched]++;
 }
 
 
-void end_of_clock_cycle(CPU *cpu)
+// move as many uops as fit from one front-end latch into the next
+static void advance_latch(Latch *from, Latch *to, int width)
 {
-    switch(cpu->issue.opcode){
-        case ADD:
-        case ADDL:
-        case SUB:
-        case SUBL:
-        case SET:
-            if(!cpu->add.occupied){
-                cpu->add = cpu->issue;
-                cpu->issue.occupied = FALSE;
-            }
+    int n = width - to->count;
+    if (n > from->count)
+    {
+        n = from->count;
     }
-
-    /* Read Registers stage */
-    if (!cpu->issue.occupied)
+    if (n == 0)
     {
-        get_RS(cpu);
-        cpu->read_registers.occupied = FALSE;
+        return;
     }
-
-    /* Analyze stage */
-    if (!cpu->read_registers.occupied)
+    // a handful of ints, plain loops beat a library call here
+    for (int i = 0; i < n; i++)
     {
-        cpu->read_registers = cpu->analyze;
-        cpu->analyze.occupied = FALSE;
+        to->uop[to->count + i] = from->uop[i];
     }
-
-    /* Decode stage */
-    if (!cpu->analyze.occupied)
+    to->count += n;
+    from->count -= n;
+    for (int i = 0; i < from->count; i++)
     {
-        cpu->analyze = cpu->decode;
-        cpu->decode.occupied = FALSE;
+        from->uop[i] = from->uop[i + n];
     }
+}
+
+void end_of_clock_cycle(CPU *cpu)
+{
+    int width = CONFIG(cpu, fetch_width);
+
+    /* Execute stages, finished results wait for a writeback port */
+    fu_finish(cpu);
+    cpu->issue.count = 0;
 
-    /* Fetch stage */
-    if (cpu->fetch.occupied && !cpu->decode.occupied)
+    /* Analyze, Decode and Fetch stages */
+    advance_latch(&cpu->analyze, &cpu->read_registers, width);
+    advance_latch(&cpu->decode, &cpu->analyze, width);
+
+    // decode takes from the head of the fetch buffer
+    FetchBuffer *buffer = &cpu->fetch;
+    if (cpu->decode.count < width && buffer->count == 0)
+    {
+        cpu->frontend.starved_cycles++;
+    }
+    cpu->frontend.buffer_occupancy += buffer->count;
+    while (cpu->decode.count < width && buffer->count > 0)
     {
-        cpu->decode = cpu->fetch;
-        cpu->fetch.occupied = FALSE;
+        cpu->decode.uop[cpu->decode.count++] = buffer->uop[buffer->head];
+        buffer->head = (buffer->head + 1) % buffer->size;
+        buffer->count--;
     }
 }
 // ============================ OUTPUT =============================
@@ -759,16 +950,23 @@ void print_output(char *filename, char *output)
     fclose(fp);
 }
 
-void print_instruction(char *stage, Stage s)
+void print_instruction(CPU *cpu, char *stage, int latch)
 {
-    if (s.occupied)
+    if (latch != NO_UOP)
     {
+        char text[64];
         printf("%s", stage);
         printf("%*c", 10, ' ');
         printf(": ");
-        // printf("%s R%d #%d #%d", instructions[s.inst->opcode], s.inst->rd, s.src1_value, s.src2_value);
-        printf("%s\n", s.inst);
-        // printf("\n");
+        printf("%s\n", instruction_text(cpu, &cpu->uops[latch], text, sizeof(text)));
+    }
+}
+
+void print_latch(CPU *cpu, char *stage, Latch *latch)
+{
+    for (int i = 0; i < latch->count; i++)
+    {
+        print_instruction(cpu, stage, latch->uop[i]);
     }
 }
 
@@ -776,22 +974,45 @@ void print_instruction(char *stage, Stage s)
 void print_instruction_info(CPU *cpu, int cycle)
 {
 
+    unsigned int categories = cpu->trace->categories;
+
     printf("======================================================\n");
     printf("Clock Cycle #: %d\n", cycle + 1);
     printf("-------------------------------------------------------\n");
-    print_instruction("RS  ", cpu->retire_1);
-    print_instruction("WB  ", cpu->writeback_1);
-    print_instruction("MEM2", cpu->mem2);
-    print_instruction("MEM1", cpu->mem1);
-    print_instruction("BR  ", cpu->branch);
-    print_instruction("DIV ", cpu->div);
-    print_instruction("MUL ", cpu->mul);
-    print_instruction("ADD ", cpu->add);
-    print_instruction("IS  ", cpu->issue);
-    print_instruction("RR  ", cpu->read_registers);
-    print_instruction("IA  ", cpu->analyze);
-    print_instruction("ID  ", cpu->decode);
-    print_instruction("IF  ", cpu->fetch);
+    if (categories & TRACE_ROB)
+    {
+        print_latch(cpu, "RS  ", &cpu->retire);
+        print_latch(cpu, "WB  ", &cpu->writeback);
+    }
+    if (categories & TRACE_EXEC)
+    {
+        // in execution, by the cycle they finish
+        FUPool *pool = cpu->fu_pool;
+        for (int d = 0; d < pool->wheel_size; d++)
+        {
+            int slot = (cpu->clockCycle + d) % pool->wheel_size;
+            for (int i = 0; i < pool->wheel_count[slot]; i++)
+            {
+                static char *labels[FU_CLASSES] = {"ADD ", "MUL ", "DIV ", "MEM ", "BR  "};
+                int id = pool->wheel[slot * pool->slot_size + i];
+                print_instruction(cpu, labels[cpu->uops[id].fu], id);
+            }
+        }
+    }
+    if (categories & TRACE_RS)
+    {
+        print_latch(cpu, "IS  ", &cpu->issue);
+        print_latch(cpu, "RR  ", &cpu->read_registers);
+    }
+    if (categories & TRACE_FETCH)
+    {
+        print_latch(cpu, "IA  ", &cpu->analyze);
+        print_latch(cpu, "ID  ", &cpu->decode);
+        for (int i = 0; i < cpu->fetch.count; i++)
+        {
+            print_instruction(cpu, "IF  ", cpu->fetch.uop[(cpu->fetch.head + i) % cpu->fetch.size]);
+        }
+    }
 }
 
 // =================================================================
@@ -801,7 +1022,43 @@ void print_instruction_info(CPU *cpu, int cycle)
  */
 void CPU_stop(CPU *cpu)
 {
+    if (cpu->image && !cpu->shared_program)
+    {
+        image_close(cpu->image);
+        free(cpu->image);
+    }
+    if (cpu->stream)
+    {
+        stream_close(cpu->stream);
+    }
+    if (cpu->memory)
+    {
+        memory_close(cpu->memory);
+        free(cpu->memory);
+    }
+    if (cpu->trace)
+    {
+        trace_close(cpu->trace);
+    }
+    if (!cpu->shared_program)
+    {
+        program_free(cpu->program);
+    }
+    free(cpu->rob.entries);
+    RS_Free(cpu);
+    rename_free(cpu);
+    lsq_free(cpu);
+    cache_destroy(cpu->l1i);
+    cache_destroy(cpu->l1d);
+    cache_destroy(cpu->l2);
+    free(cpu->fetch.uop);
+    fu_free(cpu);
+    predictor_free(cpu);
+    functional_free(cpu);
+    free(cpu->uops);
+    free(cpu->completed);
     free(cpu->regs);
+    free(cpu->regs_copy);
     free(cpu);
 }
 
@@ -823,6 +1080,40 @@ void print_registers(CPU *cpu)
     printf("================================\n\n");
 }
 
+// per-cycle dump of the register file, ROB, RS and predictor tables
+void print_state(CPU *cpu, unsigned int categories)
+{
+    if (categories & TRACE_REGS)
+    {
+        printf("\n Register Values \n");
+        for(int i=0;i<REG_COUNT;i++){
+            printf("R%d: [%d, P%d, %d]\n", i, cpu->regs[i].status, cpu->rename->map[i], cpu->regs[i].value);
+        }
+    }
+    if (categories & TRACE_ROB)
+    {
+        printf("\n Reorder Buffer \n");
+        for(int i=0;i<CONFIG(cpu, rob_size);i++){
+            printf("R0B%d: [dest: %d, result: %d, e: %d, completed: %d]\n", i, cpu->rob.entries[i].destinationReg, cpu->rob.entries[i].result, cpu->rob.entries[i].exception, cpu->rob.entries[i].completed);
+        }
+    }
+    if (categories & TRACE_RS)
+    {
+        printf("\n Reservation Stations \n");
+        for(int i=0;i<CONFIG(cpu, rs_size);i++){
+            static const Stage empty = {.rob = NO_UOP};
+            const Stage *e = cpu->rs.entries[i] == NO_UOP ? &empty : &cpu->uops[cpu->rs.entries[i]];
+            printf("RS%d: [valid: %d, opcode: %d, dest: %d, src1: %d (%d), src2: %d (%d)]\n", i, e->valid, e->opcode, e->rob, e->src1_value, e->src1_ready, e->src2_value, e->src2_ready);
+        }
+    }
+    if (categories & TRACE_PREDICTOR)
+    {
+        printf("\n Branch Predictor \n");
+        predictor_print_state(cpu);
+    }
+    printf("=================\n\n");
+}
+
 void print_display(CPU *cpu, int cycle)
 {
     printf("================================\n");
@@ -838,64 +1129,69 @@ void print_display(CPU *cpu, int cycle)
     printf("\n");
 }
 
-// load memeory map and read into array
-int load_memory_map(char *filename, CPU *cpu)
+// run the next count instructions on the functional model and hand its
+// state to the pipeline; what warming taught the caches and predictor
+// stays, their counters start over with the detailed run. Returns the
+// instructions run, fewer than count when the program ends first.
+long CPU_fast_forward(CPU *cpu, long count)
 {
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL)
-    {
-        printf("Error opening memory map file: %s\n", filename);
-        exit(1);
-    }
-
-    int address, value;
-    int num_values = 0;
-    char buff[512];
-
-    while (fscanf(fp, "%d", &value) == 1)
+    struct timespec start, end;
+    Cache *caches[] = {cpu->l1i, cpu->l1d, cpu->l2};
+    long n;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = functional_run(cpu, count, cpu->warm);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cpu->fast_forwarded += n;
+    cpu->fast_forward_ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    functional_handoff(cpu);
+    rename_reset(cpu);
+    predictor_clear_stats(cpu);
+    for (int i = 0; i < (int)ARRLEN(caches); i++)
     {
-        if (num_values >= MEMORY_SIZE)
+        if (caches[i])
         {
-            printf("Error: Address %x exceeds maximum memory size of %d\n", num_values, MEMORY_SIZE);
-            exit(1);
+            memset(&caches[i]->stats, 0, sizeof(caches[i]->stats));
         }
-        cpu->data_mem[num_values] = value;
-        num_values++;
     }
-
-    fclose(fp);
-
-    return num_values;
+    return n;
 }
 
 /*
- *  CPU simulation loop
+ * Loads the program and data memory of a run and gets it ready for its
+ * first cycle: from the start, after a fast-forward or from a checkpoint.
  */
-int CPU_run(CPU *cpu, char *filename)
+int CPU_setup(CPU *cpu, char *filename)
 {
-    // Initialize program counter (PC)
-    int pc = 0;
-    // Initialize cycle counter
-    int cycle_count = 0;
-    // Initialize stall counter
-    int stall_count = 0;
     // Initialize instruction counter
     int instruction_count = 0;
 
-    RS_Init();
-    ROB_Init();
+    // a checkpoint brings the configuration it was taken with
+    if (cpu->restore_file && checkpoint_read_config(cpu->restore_file, &cpu->config))
+    {
+        return 1;
+    }
 
-    // initialize parser
-    initilize_parser();
+    // size the ROB, RS and predictor tables for this run
+    if (CPU_alloc_structures(cpu))
+    {
+        return 1;
+    }
+    rename_reset(cpu);
+    RS_Init(cpu);
+    ROB_Init(cpu);
 
     // Initialize branch predictor
-    initBranchPredictor();
+    initBranchPredictor(cpu);
 
-    // allocate memory for data_mem (memory_map)
-    memset(cpu->data_mem, 0, sizeof(int) * MEMORY_SIZE);
-
-    // load memory map file to data_mem array
-    int num_values = load_memory_map("memory_map.txt", cpu);
+    // map the memory image copy-on-write (text memory maps are parsed)
+    cpu->memory = malloc(sizeof(DataMemory));
+    if (!cpu->memory || memory_open(cpu->memory_file, cpu->memory))
+    {
+        return 1;
+    }
+    cpu->data_mem = cpu->memory->words;
+    cpu->memory_size = cpu->memory->word_count;
 
     // program counter
     cpu->pc = 0;
@@ -903,95 +1199,350 @@ int CPU_run(CPU *cpu, char *filename)
     // flush
     cpu->flush = 0;
 
-    // code memory with instructions
-    cpu->code_mem = load_instructions(filename, &instruction_count);
+    // empty pipeline
+    cpu->uop_head = cpu->uop_tail = 0;
+    cpu->retire.count = 0;
+    flushStages(cpu);
+
+    // code memory with instructions, images are mapped instead of parsed
+    if (cpu->shared_program)
+    {
+        // loaded by the caller and only read, other CPUs may be using it
+        instruction_count = cpu->program ? cpu->program->size : cpu->image->code_count;
+    }
+    else if (cpu->stream_window > 0)
+    {
+        // decoded lazily by the reader thread, the size is found at EOF
+        cpu->stream = stream_open(filename, cpu->stream_window);
+        if (!cpu->stream)
+        {
+            return 1;
+        }
+        instruction_count = INT_MAX;
+    }
+    else if (is_program_image(filename))
+    {
+        cpu->image = malloc(sizeof(ProgramImage));
+        if (!cpu->image || image_open(filename, cpu->image))
+        {
+            return 1;
+        }
+        instruction_count = cpu->image->code_count;
+    }
+    else
+    {
+        cpu->program = load_program(filename);
+        if (!cpu->program)
+        {
+            return 1;
+        }
+        instruction_count = cpu->program->size;
+    }
 
     // code size (instructions count)
     cpu->code_size = instruction_count;
 
+    cpu->clockCycle = 0;
+    cpu->program_error = FALSE;
+    cpu->stalled_cycles = 0;
+    cpu->simulation_count = 0;
+    cpu->branches = 0;
+    cpu->mispredicts = 0;
+    cpu->fault = FALSE;
+    memset(&cpu->issue_stats, 0, sizeof(cpu->issue_stats));
+    memset(cpu->fu_pool->stats, 0, sizeof(cpu->fu_pool->stats));
+    memset(&cpu->frontend, 0, sizeof(cpu->frontend));
+    memset(&cpu->wrong_path, 0, sizeof(cpu->wrong_path));
+    functional_reset(cpu);
+    memset(&cpu->commit, 0, sizeof(cpu->commit));
+    memset(&cpu->writeback_stats, 0, sizeof(cpu->writeback_stats));
+    memset(&cpu->rename->stats, 0, sizeof(cpu->rename->stats));
+    memset(&cpu->lsq->stats, 0, sizeof(cpu->lsq->stats));
+    if (cpu->l1i)
+    {
+        cache_reset(cpu->l1i);
+    }
+    if (cpu->l1d)
+    {
+        cache_reset(cpu->l1d);
+    }
+    if (cpu->l2)
+    {
+        cache_reset(cpu->l2);
+    }
+
+    cpu->fast_forwarded = 0;
+    cpu->fast_forward_ns = 0;
+    cpu->measure_cycle = -1;
+    cpu->measure_count = 0;
+    if (cpu->restore_file)
+    {
+        // everything set up above is replaced, the run carries on from there
+        if (checkpoint_restore(cpu, cpu->restore_file))
+        {
+            return 1;
+        }
+    }
+    else if (cpu->fast_forward > 0)
+    {
+        CPU_fast_forward(cpu, cpu->fast_forward);
+    }
+    return 0;
+}
+
+/*
+ *  CPU simulation loop
+ */
+int CPU_run(CPU *cpu, char *filename)
+{
     int PAUSE = FALSE;
-    cpu->halt_flag.halt = FALSE;
+
+    if (CPU_setup(cpu, filename))
+    {
+        return 1;
+    }
+
+    Trace *trace = cpu->trace;
+    trace_start(trace);
+
+    // host cost of the loop, reported with the statistics
+    struct timespec host_start, host_end;
+    clock_gettime(CLOCK_MONOTONIC, &host_start);
+#ifdef __x86_64__
+    uint64_t tsc_start = __rdtsc();
+#endif
 
     while(!PAUSE)
     {
+        if (cpu->checkpoint_file && cpu->clockCycle == cpu->checkpoint_cycle &&
+            checkpoint_save(cpu, cpu->checkpoint_file))
+        {
+            return 1;
+        }
         retire_stage(cpu);
         writeback_stage(cpu);
-        add_stage(cpu);
+        issue_stage(cpu);
         read_registers_stage(cpu);
         analyze_stage(cpu);
         decode_stage(cpu);
         fetch_stage(cpu);
-        print_instruction_info(cpu, cpu->clockCycle);
+        if (TRACE_ON(trace, TRACE_STAGE, TRACE_ALL, cpu->clockCycle))
+        {
+            print_instruction_info(cpu, cpu->clockCycle);
+        }
         end_of_clock_cycle(cpu);
 
-        printf("\n Register Values \n");
-        for(int i=0;i<REG_COUNT;i++){
-            printf("R%d: [%d, %d, %d]\n", i, cpu->regs[i].status, cpu->regs[i].tag, cpu->regs[i].value);
-        }
-        printf("\n Reorder Buffer \n");
-        for(int i=0;i<ARRLEN(rob.entries);i++){
-            printf("R0B%d: [dest: %d, result: %d, e: %d, completed: %d]\n", i, rob.entries[i].destinationReg, rob.entries[i].result, rob.entries[i].exception, rob.entries[i].completed);
+        if (TRACE_ON(trace, TRACE_FULL, TRACE_ALL, cpu->clockCycle))
+        {
+            print_state(cpu, trace->categories);
         }
-        printf("=================\n\n");
         cpu->clockCycle++;
 
+        if (cpu->max_cycles && cpu->clockCycle >= cpu->max_cycles)
+        {
+            PAUSE = TRUE;
+        }
+        // the rest of the program cannot be read
+        if (cpu->program_error)
+        {
+            PAUSE = TRUE;
+        }
+        if (cpu->max_instructions)
+        {
+            if (cpu->measure_cycle < 0 && cpu->simulation_count >= cpu->measure_from)
+            {
+                cpu->measure_cycle = cpu->clockCycle;
+                cpu->measure_count = cpu->simulation_count;
+            }
+            if (cpu->simulation_count >= cpu->max_instructions)
+            {
+                PAUSE = TRUE;
+            }
+        }
+        // ret committed
+        if (cpu->halt_flag.halt)
+        {
+            PAUSE = TRUE;
+        }
+        // no ret: fetch is past the last instruction and all before it committed
+        if (cpu->fetch_halted && ROB_IsEmpty(cpu) && cpu->fetch.count == 0 && cpu->decode.count == 0 &&
+            cpu->analyze.count == 0 && cpu->read_registers.count == 0)
+        {
+            PAUSE = TRUE;
+        }
+    }
+
+#ifdef __x86_64__
+    cpu->host_cycles = __rdtsc() - tsc_start;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &host_end);
+    cpu->host_ns = (host_end.tv_sec - host_start.tv_sec) * 1e9 + (host_end.tv_nsec - host_start.tv_nsec);
+    if (cpu->checkpoint_file && cpu->clockCycle <= cpu->checkpoint_cycle)
+    {
+        fprintf(stderr, "Warning: the run ended before cycle %ld, no checkpoint written\n", cpu->checkpoint_cycle);
+    }
+
+    if (cpu->fault)
+    {
+        return 1;
     }
 
-    // loop through stages
-    // while (!PAUSE)
-    // {
-    //     if (writeback_stage(cpu))
-    //     {
-    //         PAUSE = TRUE;
-    //     }
-    //     memory2_stage(cpu);
-    //     memory1_stage(cpu);
-    //     branch_stage(cpu);
-    //     div_stage(cpu);
-    //     mul_stage(cpu);
-    //     add_stage(cpu);
-    //     read_registers_stage(cpu);
-    //     analyze_stage(cpu);
-    //     decode_stage(cpu);
-    //     fetch_stage(cpu);
-    //     // print_instruction_info(cpu, cpu->clockCycle);
-    //     end_of_clock_cycle(cpu);
-    //     // incrementclock cycle
-    //     cpu->clockCycle++;
-    //     print_display(cpu,cpu->clockCycle);
-    // }
-
-    // write memeory map to text file
-    // input: filename.txt output: filename_output.txt
-    // output filename
-    // char* output_filename = (char*) malloc(strlen(filename) + 11);
-    // char *fle = strrchr(filename, '/');
-    // if(fle != NULL){
-    //     fle++;
-    //     strcpy(filename, fle);
-    // }
-    // sprintf(output_filename, "mmap_%s", filename);
-    // FILE *fpp = fopen(output_filename, "w+");
-    // if(fpp == NULL){
-    //     printf("Error: could not open file \n");
-    //     return 1;
-    // }
-    // for (int i = 0; i < num_values; i++) {
-    //     fprintf(fpp, "%d ", cpu->data_mem[i]); // write each element of the array to the file
-    // }
-    // fclose(fpp);
-    // free(output_filename);
-
-    // simulation output
-    print_registers(cpu);
-    printf("Stalled cycles due to data hazard: %d\n", cpu->stalled_cycles);
-    printf("Total execution cycles: %d\n", cpu->clockCycle);
-    printf("Total instruction simulated: %d\n", simulation_count);
-    printf("IPC: %f\n", (float)simulation_count / cpu->clockCycle);
+    if (cpu->program_error)
+    {
+        return 1;
+    }
+
+    // write the final data memory in one call
+    if (cpu->dump_file && memory_dump(cpu->dump_file, cpu->data_mem, cpu->memory_size))
+    {
+        return 1;
+    }
 
     return 0;
 }
 
+/*
+ * Final register file and statistics of a finished run.
+ */
+void CPU_print_stats(CPU *cpu)
+{
+    Trace *trace = cpu->trace;
+
+    if (TRACE_MAX_LEVEL >= TRACE_SUMMARY && trace->level >= TRACE_SUMMARY)
+    {
+        print_registers(cpu);
+    }
+    printf("Stalled cycles due to data hazard: %d\n", cpu->stalled_cycles);
+    printf("Total execution cycles: %d\n", cpu->clockCycle);
+    printf("Total instruction simulated: %d\n", cpu->simulation_count);
+    printf("IPC: %f\n", (float)cpu->simulation_count / cpu->clockCycle);
+    if (cpu->fast_forward > 0)
+    {
+        printf("Fast-forwarded: %ld instructions before the pipeline started, %.1f million per second%s\n",
+               cpu->fast_forwarded, cpu->fast_forward_ns ? 1e3 * cpu->fast_forwarded / cpu->fast_forward_ns : 0.0,
+               cpu->warm ? ", caches and predictor warmed" : "");
+    }
+    if (cpu->clockCycle)
+    {
+        FrontendStats *fs = &cpu->frontend;
+        long slots = (long)cpu->clockCycle * CONFIG(cpu, fetch_width);
+        printf("Fetch slots used: %ld of %ld (%.1f%%)\n", fs->fetch[SLOT_USED], slots,
+               100.0 * fs->fetch[SLOT_USED] / slots);
+        printf("  lost to taken branch %ld, block end %ld, ret/end %ld, uop pool %ld, buffer full %ld, flush %ld,\n"
+               "  decode redirect %ld, instruction cache %ld, wrong path %ld\n",
+               fs->fetch[SLOT_TAKEN], fs->fetch[SLOT_BLOCK], fs->fetch[SLOT_END], fs->fetch[SLOT_POOL],
+               fs->fetch[SLOT_STALL], fs->fetch[SLOT_FLUSH], fs->fetch[SLOT_DECODE], fs->fetch[SLOT_ICACHE],
+               fs->fetch[SLOT_WRONG]);
+        printf("  cycles by group size:");
+        for (int i = 0; i <= CONFIG(cpu, fetch_width); i++)
+        {
+            printf(" %d:%ld", i, fs->fetch_groups[i]);
+        }
+        printf("\n");
+        printf("Redirects: BTB at fetch %ld, decode after a BTB miss %ld (%ld uops dropped),\n"
+               "  mispredict %ld (%ld squashed), replay %ld (%ld squashed)\n",
+               fs->redirects[REDIRECT_BTB], fs->redirects[REDIRECT_DECODE], fs->squashed[REDIRECT_DECODE],
+               fs->redirects[REDIRECT_MISPREDICT], fs->squashed[REDIRECT_MISPREDICT], fs->redirects[REDIRECT_REPLAY],
+               fs->squashed[REDIRECT_REPLAY]);
+        if (fs->redirects[REDIRECT_MISPREDICT])
+        {
+            double resolve = (double)fs->resolve_cycles / fs->redirects[REDIRECT_MISPREDICT];
+            double refill = fs->refills ? (double)fs->refill_cycles / fs->refills : 0.0;
+            printf("Mispredict penalty: %.1f cycles, %.1f from fetch to resolve and %.1f to refill the front end\n",
+                   resolve + refill, resolve, refill);
+        }
+        if (CONFIG(cpu, wrong_path))
+        {
+            WrongPathStats *wp = &cpu->wrong_path;
+            printf("Wrong path: fetched %ld (%.1f%% of fetch), executed %ld, branches predicted %ld,\n"
+                   "  instruction cache reads %ld, loads %ld (%ld read the data cache or memory), stores %ld\n",
+                   wp->fetched, fs->fetch[SLOT_USED] ? 100.0 * wp->fetched / fs->fetch[SLOT_USED] : 0.0,
+                   wp->executed, wp->branches, wp->icache_reads, wp->loads, wp->memory_reads, wp->stores);
+        }
+        printf("Fetch buffer: %d entries, avg occupancy %.1f, decode starved %ld cycles, "
+               "instruction cache stalls %ld cycles\n",
+               cpu->fetch.size, (double)fs->buffer_occupancy / cpu->clockCycle, fs->starved_cycles,
+               fs->icache_stall_cycles);
+        if (cpu->l1i)
+        {
+            cache_print_stats(cpu->l1i);
+        }
+        printf("Dispatch slots used: %ld of %ld (%.1f%%)\n", fs->dispatch[SLOT_USED], slots,
+               100.0 * fs->dispatch[SLOT_USED] / slots);
+        printf("  lost to empty latch %ld, ROB full %ld, RS full %ld, free list empty %ld, no checkpoint %ld,\n"
+               "  load queue full %ld, store queue full %ld\n",
+               fs->dispatch[SLOT_EMPTY], fs->dispatch[SLOT_ROB], fs->dispatch[SLOT_RS], fs->dispatch[SLOT_PRF],
+               fs->dispatch[SLOT_CHECKPOINT], fs->dispatch[SLOT_LQ], fs->dispatch[SLOT_SQ]);
+        RenameStats *rs = &cpu->rename->stats;
+        printf("Physical registers: %d, in use avg %.1f max %d\n", cpu->rename->size,
+               (double)rs->in_use_cycles / cpu->clockCycle, rs->in_use_max);
+        printf("  dispatch stalled on empty free list %ld cycles, on %d checkpoints %ld cycles\n",
+               rs->free_list_stalls, CONFIG(cpu, checkpoints), rs->checkpoint_stalls);
+        predictor_print_stats(cpu);
+        printf("Mispredict recoveries: %ld, cycles from resolve to restored map avg %.1f max %ld\n",
+               rs->recoveries, rs->recoveries ? (double)rs->recovery_cycles / rs->recoveries : 0.0,
+               rs->recovery_max);
+        CommitStats *cs = &cpu->commit;
+        slots = (long)cpu->clockCycle * CONFIG(cpu, commit_width);
+        printf("Commit slots used: %d of %ld (%.1f%%)\n", cpu->simulation_count, slots,
+               100.0 * cpu->simulation_count / slots);
+        printf("  cycles by group size:");
+        for (int i = 0; i <= CONFIG(cpu, commit_width); i++)
+        {
+            printf(" %d:%ld", i, cs->groups[i]);
+        }
+        printf("\n");
+        printf("ROB full stall cycles: %ld\n", cs->rob_full_cycles);
+        IssueStats *is = &cpu->issue_stats;
+        printf("Issue width: %d, cycles by uops issued:", CONFIG(cpu, issue_width));
+        for (int i = 0; i <= CONFIG(cpu, issue_width); i++)
+        {
+            printf(" %d:%ld", i, is->groups[i]);
+        }
+        printf("\n");
+        printf("  ready uops left waiting: %ld\n", is->ready_left);
+        printf("Functional units: units latency interval issued busy%% structural-stalls\n");
+        for (int fu = 0; fu < FU_CLASSES; fu++)
+        {
+            FUStats *f = &cpu->fu_pool->stats[fu];
+            printf("  %-6s %5d %7d %8d %6ld %5.1f%% %ld\n", fu_names[fu], CONFIG(cpu, fu[fu].count),
+                   CONFIG(cpu, fu[fu].latency),
+                   CONFIG(cpu, fu[fu].pipelined) ? CONFIG(cpu, fu[fu].interval) : CONFIG(cpu, fu[fu].latency),
+                   f->issued, 100.0 * f->busy_cycles / ((double)cpu->clockCycle * CONFIG(cpu, fu[fu].count)),
+                   f->structural_stalls);
+        }
+        LSQStats *ls = &cpu->lsq->stats;
+        printf("Load/store queue: %d loads, %d stores\n", CONFIG(cpu, lq_size), CONFIG(cpu, sq_size));
+        printf("  loads executed %ld, forwarded %ld, ahead of unknown store addresses %ld, replayed %ld\n",
+               ls->loads, ls->forwarded, ls->speculated, ls->violations);
+        printf("  stores executed %ld\n", ls->stores);
+        if (cpu->l2)
+        {
+            cache_print_stats(cpu->l2);
+        }
+        if (cpu->l1d)
+        {
+            cache_print_stats(cpu->l1d);
+            printf("Average memory access time: %.2f cycles over %ld cached loads\n",
+                   cpu->l1d->stats.reads ? (double)cpu->l1d->stats.read_cycles / cpu->l1d->stats.reads : 0.0,
+                   cpu->l1d->stats.reads);
+        }
+        WritebackStats *ws = &cpu->writeback_stats;
+        printf("Writeback ports: %d, cycles by results written:", CONFIG(cpu, writeback_width));
+        for (int i = 0; i <= CONFIG(cpu, writeback_width); i++)
+        {
+            printf(" %d:%ld", i, ws->groups[i]);
+        }
+        printf("\n");
+        printf("  port conflicts delayed %ld results by %ld cycles (max %ld)\n", ws->delayed, ws->delay_cycles,
+               ws->max_delay);
+        printf("Host time per simulated cycle: %.1f ns\n", cpu->host_ns / cpu->clockCycle);
+#ifdef __x86_64__
+        printf("Host cycles per simulated cycle: %.1f\n", (double)cpu->host_cycles / cpu->clockCycle);
+#endif
+    }
+}
+
 // create registers
 Register *
 create_registers(int size)
@@ -1004,169 +1555,83 @@ create_registers(int size)
     for (int i = 0; i < size; i++)
     {
         regs[i].status = 0;
-        regs[i].tag = 0;
+        regs[i].tag = NO_UOP;
         regs[i].value = 0;
     }
     return regs;
 }
 
 // ROB initialization
-void ROB_Init() {
-    rob.head = rob.tail = 0;
-    for (int i = 0; i < ROB_SIZE; i++) {
-        rob.entries[i].completed = TRUE;
-        rob.entries[i].exception = FALSE;
-        rob.entries[i].result = -1;
-        rob.entries[i].destinationReg = -1;
-        rob.entries[i].ROBid = i;
+void ROB_Init(CPU *cpu) {
+    cpu->rob.head = cpu->rob.tail = cpu->rob.count = 0;
+    for (int i = 0; i < CONFIG(cpu, rob_size); i++) {
+        cpu->rob.entries[i].completed = TRUE;
+        cpu->rob.entries[i].exception = FALSE;
+        cpu->rob.entries[i].result = -1;
+        cpu->rob.entries[i].destinationReg = -1;
+        cpu->rob.entries[i].uop = NO_UOP;
+        cpu->rob.entries[i].ROBid = i;
     }
 }
 
-// check if rob is full
-bool ROB_IsFull() {
-    return (rob.tail + 1) % ROB_SIZE == rob.head;
+// check if rob is full, all rob_size entries in use
+bool ROB_IsFull(CPU *cpu) {
+    return cpu->rob.count == CONFIG(cpu, rob_size);
 }
 
 // check if rob is empty
-bool ROB_IsEmpty() {
-    return rob.head == rob.tail;
+bool ROB_IsEmpty(CPU *cpu) {
+    return cpu->rob.count == 0;
 }
 
-// add entry to rob
-int ROB_Enqueue(CPU *cpu, int destReg) {
-    if (ROB_IsFull(rob)) {
+// add entry to rob for uop
+int ROB_Enqueue(CPU *cpu, int uop) {
+    if (ROB_IsFull(cpu)) {
         return -1;  // ROB is full
     }
-    int ROBid = rob.tail;
-    cpu->regs[destReg].tag = ROBid;
-    rob.tail = (rob.tail + 1) % ROB_SIZE;
-    rob.entries[ROBid].ROBid = ROBid;
-    rob.entries[ROBid].destinationReg = destReg;
-    rob.entries[ROBid].completed = FALSE;
+    Stage *s = &cpu->uops[uop];
+    int destReg = s->dest;
+    int ROBid = cpu->rob.tail;
+    TRACE_EVENT(cpu->trace, TRACE_ROB, TRACE_EV_DISPATCH, cpu->clockCycle, s->opcode, s->pc, ROBid);
+    cpu->rob.tail = (cpu->rob.tail + 1) % CONFIG(cpu, rob_size);
+    cpu->rob.count++;
+    cpu->rob.entries[ROBid].ROBid = ROBid;
+    cpu->rob.entries[ROBid].uop = uop;
+    cpu->rob.entries[ROBid].destinationReg = destReg;
+    cpu->rob.entries[ROBid].completed = FALSE;
     return ROBid;
 }
 
 // update rob result
-void ROB_Update(int ROBid, int result) {
-    rob.entries[ROBid].result = result;
-}
-
-// commit rob
-void ROB_Commit(int ROBid) {
-    rob.entries[ROBid].completed = false;
-}
-
-// check if rob is ready
-bool ROB_IsReady(int ROBid) {
-    return rob.entries[ROBid].completed && !rob.entries[ROBid].exception;
+void ROB_Update(CPU *cpu, int ROBid, int result) {
+    cpu->rob.entries[ROBid].result = result;
 }
 
-void RS_Init() {
-    rs.head = rs.tail = 0;
-    for (int i = 0; i < RS_SIZE; i++) {
-        rs.entries[i].valid = false;
-        rs.entries[i].src1_ready = rs.entries[i].src2_ready = false;
-    }
-}
-
-bool RS_IsFull() {
-    return (rs.tail + 1) % RS_SIZE == rs.head;
-}
-
-bool RS_IsEmpty() {
-    return rs.head == rs.tail;
-}
-
-int RS_Enqueue(CPU *cpu, int opcode, int operand1, int operand2, int destReg) {
-    if (RS_IsFull()) {
-        return -1;  // RS is full
-    }
-    int RSEntryId = rs.tail;
-    rs.tail = (rs.tail + 1) % RS_SIZE;
-    rs.entries[RSEntryId] = cpu->read_registers;
-    rs.entries[RSEntryId].opcode = cpu->read_registers.inst->opcode;
-    rs.entries[RSEntryId].valid = true;
-    rs.entries[RSEntryId].src1_ready = rs.entries[RSEntryId].src2_ready = false;
-    return RSEntryId;
-}
-
-bool RS_IsReady(int RSEntryId) {
-    return rs.entries[RSEntryId].valid && rs.entries[RSEntryId].src1_ready && rs.entries[RSEntryId].src2_ready;
-}
-
-void RS_Clear(int RSEntryId) {
-    rs.entries[RSEntryId].valid = false;
-}
-
-void get_RS(CPU *cpu){
-    int RSEntryId = rs.tail-1;
-    cpu->issue = rs.entries[RSEntryId];
-}
-
-// Initialize BTB and PT
-void initBranchPredictor() {
-    for (int i = 0; i < BTB_SIZE; i++) {
-        btb[i].tag = -1;
-        btb[i].target_address = -1;
-    }
-    for (int i = 0; i < PT_SIZE; i++) {
-        pt[i].counter = 3;
-    }
+// untrained predictor tables and an empty BTB
+void initBranchPredictor(CPU *cpu) {
+    predictor_reset(cpu);
 }
 
-// Function to update BTB and PT with actual branch outcome
-void updateBranchPredictor(CPU *cpu, int addr, int actual_outcome) {
-    Instruction *inst = cpu->branch.inst;
-    Stage *s = &cpu->branch;
-    
-    int pc = inst->instruction_no * 4;
-
-    // Extract BTB index and tag from PC
-    int btb_index = (pc >> 2) & 0xF;
-    int tag = (pc & PC_TAG) >> 6;
-
-    // Update PT with actual branch outcome
-    int pt_index = (pc >> 2) & 0xF;
-
-    if(actual_outcome){
-        if(btb[btb_index].tag < 0 || pt[pt_index].counter < 4){
-            cpu->flush = TRUE;
-            flushStages(cpu);
-            cpu->pc = addr/4;
-        }
-    }else{
-        if(btb[btb_index].tag >= 0 && pt[pt_index].counter >= 4){
-            cpu->flush = TRUE;
-            flushStages(cpu);
-            cpu->pc = inst->instruction_no + 1;
-        }
-    }
-    btb[btb_index].tag = tag;
-    btb[btb_index].target_address = addr;
-
-    if (actual_outcome) {
-        if (pt[pt_index].counter < 7) {
-            pt[pt_index].counter++;
-        }
-    } else {
-        if (pt[pt_index].counter > 0) {
-            pt[pt_index].counter--;
-        }
+// train the predictor with the outcome of a committing branch, returns
+// TRUE when fetch went the wrong way
+int updateBranchPredictor(CPU *cpu, int uop, int actual_outcome) {
+    Stage *s = &cpu->uops[uop];
+    int mispredicted = predictor_update(cpu, s, actual_outcome);
+
+    TRACE_EVENT(cpu->trace, TRACE_PREDICTOR, TRACE_EV_BRANCH, cpu->clockCycle, s->opcode, s->pc, actual_outcome);
+    cpu->branches++;
+    if(mispredicted){
+        cpu->mispredicts++;
+        TRACE_EVENT(cpu->trace, TRACE_PREDICTOR, TRACE_EV_MISPREDICT, cpu->clockCycle, s->opcode, s->pc,
+                    actual_outcome ? s->imm / 4 : s->pc + 1);
     }
+    return mispredicted;
 }
 
-// Function to predict branch outcome
-int predictBranchOutcome(int pc) {
-
-    int pt_index;
-
-    pt_index = ((pc*4) >> 2) & 0xF;
-
-    // Predict branch outcome based on PT counter value
-    if (pt[pt_index].counter >= 4) {
-        return 1;   // Predict taken
-    } else {
-        return 0;   // Predict not-taken
-    }
+// direction of the branch uop being fetched, *target is where it goes if
+// the BTB holds it
+int predictBranchOutcome(CPU *cpu, Stage *uop, int *target) {
+    uop->btb_hit = btb_lookup(cpu, uop->pc, target);
+    return predictor_predict(cpu, uop);
 }
 
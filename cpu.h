@@ -10,7 +10,9 @@
 #ifndef _CPU_H_
 #define _CPU_H_
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
+#include "config.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -21,23 +23,6 @@
 
 #define ARRLEN(x) (sizeof(x) / sizeof((x)[0]))
 
-// Constants for BTB and PT sizes
-#define BTB_SIZE 16
-#define PT_SIZE 16
-
-#define PC_TAG 0xFFFFFFC0
-
-// BTB entry structure
-typedef struct BTBEntry{
-    int tag;
-    int target_address;
-} BTBEntry;
-
-// PT entry structure
-typedef struct PTEntry{
-    int counter;
-} PTEntry;
-
 /* Define opcodes as constants */
 #define MUL     0
 #define ADD     1
@@ -59,10 +44,13 @@ typedef struct PTEntry{
 #define BLTZ    17
 #define RET     18
 
-#define ROB_SIZE 8
+#define IS_BRANCH(opcode) ((opcode) >= BEZ && (opcode) <= BLTZ)
+
+// empty pipeline latch, also "no register" and "no producer"
+#define NO_UOP  -1
 
+// decoded instruction as produced by the parser and image decoder
 typedef struct Instruction{
-    char instruction[32];
     int instruction_no;
     int opcode;
     int rd;
@@ -70,24 +58,144 @@ typedef struct Instruction{
     int rs2;
     int op1;
 } Instruction;
+
+// in-flight instruction; latches, RS and ROB refer to it by its pool index
 typedef struct Stage
 {
+    unsigned int seq;       // fetch order, the pool index is seq masked
     int pc;
-    Instruction* inst;
-    int opcode;
-    int dest_value;
+    uint8_t opcode;
+    uint8_t fu;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int imm;
+    // set by decode, NO_UOP when the operand is unused or an immediate
+    int8_t dest;
+    int8_t src1_reg;
+    int8_t src2_reg;
+    // set by rename, a source waits on its tag (a physical register) until ready
+    int rob;
+    int preg;               // physical destination
+    int old_preg;           // previous mapping of dest, freed when this commits
+    int checkpoint;         // branches: rename map checkpoint until resolved
+    int src1_tag;
+    int src2_tag;
     int src1_value;
     int src2_value;
     int result;
     int addr;
-    int occupied;
+    int done_cycle;         // cycle execution finished, it then waits for a writeback port
+    int fetch_cycle;
+    int rs;                 // reservation station while valid
+    int lsq;                // loads and stores: entry in the load or store queue
     bool valid;
     bool src1_ready;
     bool src2_ready;
+    bool predicted_taken;
+    uint64_t history;       // branches: global history they were predicted with
+    bool btb_hit;           // branches: fetch found the target in the BTB
+    bool wrong_path;        // fetched past a redirect that went the wrong way
+    unsigned int path;      // right path: step of the functional model
+    int next_pc;            // right path: where the program really goes next
+    bool exception;         // raised at commit: divide by zero or bad address
+    bool replay;            // loads: read a stale value, squashed and fetched again at commit
 } Stage;
 
+// front-end latch, up to fetch_width uop indices in program order
+typedef struct Latch
+{
+    int count;
+    int uop[MAX_WIDTH];
+} Latch;
+
+// decoupled queue between fetch and decode, a ring of fetch_buffer uop
+// indices in program order; fetch fills it ahead of decode
+typedef struct FetchBuffer
+{
+    int *uop;
+    int size;
+    int head;
+    int count;
+} FetchBuffer;
+
+// why front-end slots went unused, each cycle offers fetch_width slots
+#define SLOT_USED       0
+#define SLOT_TAKEN      1   // after a predicted-taken branch
+#define SLOT_BLOCK      2   // after the end of the fetch block
+#define SLOT_END        3   // after ret or past the end of the program
+#define SLOT_POOL       4   // in-flight uop pool full
+#define SLOT_STALL      5   // fetch buffer full
+#define SLOT_FLUSH      6   // redirect after a mispredict
+#define SLOT_EMPTY      7   // dispatch: nothing to dispatch
+#define SLOT_ROB        8   // dispatch: ROB full
+#define SLOT_RS         9   // dispatch: reservation stations full
+#define SLOT_PRF        10  // dispatch: no free physical register
+#define SLOT_CHECKPOINT 11  // dispatch: no free rename checkpoint
+#define SLOT_LQ         12  // dispatch: load queue full
+#define SLOT_SQ         13  // dispatch: store queue full
+#define SLOT_ICACHE     14  // waiting for an instruction cache miss
+#define SLOT_DECODE     15  // redirect from decode after a BTB miss
+#define SLOT_WRONG      16  // fetch holds on the wrong path until the redirect
+#define SLOT_KINDS      17
+
+// what moved fetch off the sequential path
+#define REDIRECT_BTB        0   // fetch, predicted taken with the target in the BTB
+#define REDIRECT_DECODE     1   // decode, predicted taken but the BTB missed
+#define REDIRECT_MISPREDICT 2   // writeback, the branch went the other way
+#define REDIRECT_REPLAY     3   // commit, memory-order violation
+#define REDIRECT_KINDS      4
+
+typedef struct FrontendStats
+{
+    long fetch[SLOT_KINDS];
+    long dispatch[SLOT_KINDS];
+    long fetch_groups[MAX_WIDTH + 1];   // cycles by instructions fetched
+    long icache_stall_cycles;           // fetch waited on an instruction cache miss
+    long starved_cycles;                // decode had room and the fetch buffer was empty
+    long buffer_occupancy;              // fetch buffer entries, summed per cycle
+    long redirects[REDIRECT_KINDS];
+    long squashed[REDIRECT_KINDS];      // younger uops thrown away by them
+    long resolve_cycles;                // mispredicted branches, fetch to writeback
+    long refill_cycles;                 // writeback to the first right-path dispatch
+    long refills;
+} FrontendStats;
+
+// work done for uops on the wrong path, all of it squashed
+typedef struct WrongPathStats
+{
+    long fetched;
+    long branches;                      // predicted, they train nothing
+    long icache_reads;                  // instruction cache lookups
+    long executed;
+    long loads;
+    long memory_reads;                  // loads not forwarded, they read the data cache or memory
+    long stores;
+} WrongPathStats;
+
+typedef struct CommitStats
+{
+    long groups[MAX_WIDTH + 1];         // cycles by instructions committed
+    long rob_full_cycles;               // cycles dispatch waited on a full ROB
+} CommitStats;
+
+typedef struct WritebackStats
+{
+    long groups[MAX_WIDTH + 1];         // cycles by results written back
+    long delayed;                       // results that lost port arbitration at least once
+    long delay_cycles;                  // extra cycles those results waited
+    long max_delay;
+} WritebackStats;
+
+typedef struct IssueStats
+{
+    long groups[MAX_WIDTH + 1];         // cycles by uops issued
+    long ready_left;                    // ready uops left behind by the width or a busy unit
+} IssueStats;
+
 typedef struct ROBEntry {
     int ROBid;
+    int uop;                    // pool index of the instruction
     int destinationReg;
     int result;
     bool exception;
@@ -95,17 +203,21 @@ typedef struct ROBEntry {
 } ROBEntry;
 
 typedef struct ReorderBuffer {
-    ROBEntry entries[ROB_SIZE];
+    ROBEntry *entries;          // CONFIG(cpu, rob_size) entries
     int head;
     int tail;
+    int count;                  // entries in use, head == tail when empty or full
 } ReorderBuffer;
 
-#define RS_SIZE 4
-
+// see scheduler.c, each bitvector has one bit per entry
 typedef struct ReservationStation {
-    Stage entries[RS_SIZE];
-    int head;
-    int tail;
+    int *entries;               // uop indices, CONFIG(cpu, rs_size) entries, NO_UOP when free
+    int count;
+    int words;                  // 64-bit words per bitvector
+    uint64_t *valid;
+    uint64_t *ready;            // FU_CLASSES bitvectors
+    uint64_t *older;            // rs_size bitvectors
+    uint64_t *waiting;          // one bitvector per physical register
 } ReservationStation;
 
 typedef struct Register
@@ -125,49 +237,87 @@ typedef struct Halt
     int end_halt;
 } Halt;
 
-// Bubbel struct
-typedef struct Bubble
-{
-    int valid;
-    int reg;
-    int val;
-} Bubble;
-
 /* Model of CPU */
 typedef struct CPU
 {
     int pc;
     int clockCycle;
-    Instruction *code_mem;
+    struct Program *program;        // decoded text program, NULL otherwise
+    struct ProgramImage *image;     // mapped program image, NULL for text programs
+    int shared_program;             // program or image belongs to the caller, never freed here
+    struct ProgramStream *stream;   // streaming window, NULL when the program is resident
+    int stream_window;              // window size in instructions, 0 to load everything
+    int program_error;              // the stream could not read or decode an instruction
     int code_size;
     int stalled_cycles;
-    int data_mem[MEMORY_SIZE];
+    int *data_mem;                  // MEMORY_SIZE words
+    struct DataMemory *memory;      // mapping behind data_mem
+    char *memory_file;
+    char *dump_file;                // final memory is written here, NULL to skip
+    struct Trace *trace;
+    long max_cycles;                // stop after this many cycles, 0 for no limit
+    double host_ns;                 // host time spent in the last run
+    uint64_t host_cycles;           // TSC cycles spent in the last run, x86-64 only
+    long fast_forward;              // instructions run functionally before the pipeline starts
+    int warm;                       // fast-forward trains the caches and predictor
+    long fast_forwarded;            // run that way in the last run, fewer if the program ended
+    double fast_forward_ns;
+    char *checkpoint_file;          // state is saved here, NULL for none
+    long checkpoint_cycle;          // before this cycle runs
+    char *restore_file;             // run resumes from this checkpoint, NULL to start afresh
+    long max_instructions;          // stop once this many have committed, 0 for no limit
+    // with max_instructions, the cycle and commit count when measure_from
+    // instructions had committed, -1 before; a sample measures from there
+    long measure_from;
+    long measure_cycle;
+    int measure_count;
 	Register *regs;
     Register *regs_copy;
-    int memory_size;
-    int flush;
+    int memory_size;                // words loaded or written so far
+    int flush;                      // fetch slot kind lost to a redirect this cycle, 0 for none
     Halt halt_flag;
-    Bubble add_bubble;
-    Bubble mul_bubble;
-    Bubble div_bubble;
-    Bubble memory_bubble;
-	Stage fetch;
-    Stage decode;
-    Stage analyze;
-    Stage read_registers;
-    Stage issue;
-    Stage add;
-    Stage mul;
-    Stage div;
-    Stage branch;
-    Stage mem1;
-    Stage mem2;
-    Stage writeback_1;
-    Stage writeback_2;
-    Stage writeback_3;
-    Stage writeback_4;
-    Stage retire_1;
-    Stage retire_2;
+    CPUConfig config;
+    ReorderBuffer rob;
+    ReservationStation rs;
+    struct RenameState *rename;     // physical registers and the rename map
+    struct LSQ *lsq;                // loads and stores in flight
+    struct Cache *l1d;              // data cache, NULL to read data_mem directly
+    struct Cache *l2;               // NULL without a second level
+    struct Predictor *predictor;    // direction predictor and BTB
+    struct FunctionalModel *functional; // right path, ahead of fetch
+    int simulation_count;           // instructions committed
+    int branches;                   // branches resolved
+    int mispredicts;                // of which mispredicted
+    // in-flight uops, a ring of uop_count (a power of two) slots holding
+    // sequence numbers uop_head up to uop_tail
+    Stage *uops;
+    int uop_count;
+    unsigned int uop_head;
+    unsigned int uop_tail;
+    int fetch_halted;               // ret fetched or past the end of the program, nothing follows
+    struct Cache *l1i;              // instruction cache, NULL for none
+    int fetch_line;                 // instruction cache line fetch last looked up
+    long fetch_ready;               // fetch waits for a miss until this cycle
+    unsigned int refill_seq;        // first uop on the right path after a mispredict
+    long refill_cycle;              // cycle of that mispredict, -1 once it dispatched
+    FrontendStats frontend;
+    WrongPathStats wrong_path;
+    CommitStats commit;
+    WritebackStats writeback_stats;
+    IssueStats issue_stats;
+    int fault;                      // run ended on an exception
+    // front end, fetch_width uops per latch after the fetch buffer
+    FetchBuffer fetch;
+    Latch decode;
+    Latch analyze;
+    Latch read_registers;
+    Latch issue;                    // selected this cycle, issue_width uops
+    struct FUPool *fu_pool;         // units and the uops executing on them
+    // executed uops waiting for a writeback port, oldest first
+    int *completed;                 // uop_count entries
+    int completed_count;
+    Latch writeback;                // results broadcast this cycle
+    Latch retire;                   // committed this cycle, kept for the trace
 } CPU;
 
 CPU*
@@ -176,38 +326,38 @@ CPU_init();
 Register*
 create_registers(int size);
 
+int
+CPU_alloc_structures(CPU* cpu);
+
+int
+CPU_setup(CPU* cpu, char* filename);
+
+long
+CPU_fast_forward(CPU* cpu, long count);
+
 int
 CPU_run(CPU* cpu, char* filename);
 
+void
+CPU_print_stats(CPU* cpu);
+
 void
 CPU_stop(CPU* cpu);
 
 
 // =================================================================
 
-int has_two_R_letters(char* str, char* code);
-
-int getIndex(char** arr, int len, char *inst, int has_register);
-
-void parse_instructions(Instruction *instr, char *line, int no);
-
 void print_inst(Instruction *inst);
 
 void retire_stage(CPU *cpu);
 
-static int writeback_stage(CPU* cpu);
-
-void memory1_stage(CPU* cpu);
-
-void memory2_stage(CPU* cpu);
+void writeback_stage(CPU* cpu);
 
-void branch_stage(CPU* cpu);
+void complete_uop(CPU* cpu, int uop);
 
-void div_stage(CPU* cpu);
+int execute_uop(CPU* cpu, Stage* uop);
 
-void mul_stage(CPU* cpu);
-
-void add_stage(CPU* cpu);
+void issue_stage(CPU* cpu);
 
 void read_registers_stage(CPU* cpu);
 
@@ -217,44 +367,37 @@ void decode_stage(CPU* cpu);
 
 void fetch_stage(CPU* cpu);
 
+int fetch_instruction(CPU* cpu, int pc, Stage* uop);
+
+const char* instruction_text(CPU* cpu, Stage* uop, char* buffer, int size);
+
 void end_of_clock_cycle(CPU* cpu);
 
 void print_instruction_info(CPU* cpu, int cycle);
 
-void print_instruction(char* stage, Stage s);
+void print_instruction(CPU* cpu, char* stage, int latch);
 
-int load_memory_map(char* filename, CPU* cpu);
-
-int bubble_fetch(CPU *cpu, int register, int *value);
+void print_latch(CPU* cpu, char* stage, Latch* latch);
 
 void flushStages(CPU *cpu);
 
-int predictBranchOutcome(int pc);
-
-void updateBranchPredictor(CPU *cpu, int addr, int actual_outcome);
-
-void initBranchPredictor();
-
-void ROB_Init();
-
-bool ROB_IsFull();
+void squashYounger(CPU *cpu, Stage *branch);
 
-bool ROB_IsEmpty();
+int predictBranchOutcome(CPU *cpu, Stage *uop, int *target);
 
-int ROB_Enqueue(CPU *cpu, int destReg);
+int updateBranchPredictor(CPU *cpu, int uop, int actual_outcome);
 
-void ROB_Update(int ROBid, int result);
+void initBranchPredictor(CPU *cpu);
 
-void ROB_Commit(int ROBid);
+void ROB_Init(CPU *cpu);
 
-bool ROB_IsReady(int ROBid);
+bool ROB_IsFull(CPU *cpu);
 
-void RS_Init();
+bool ROB_IsEmpty(CPU *cpu);
 
-void Rename_Registers(CPU *cpu, int *dst, int *src1, int *src2);
+int ROB_Enqueue(CPU *cpu, int uop);
 
-int RS_Enqueue(CPU *cpu, int opcode, int operand1, int operand2, int destReg);
+void ROB_Update(CPU *cpu, int ROBid, int result);
 
-void get_RS(CPU *cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+ * Description: Functional unit pool.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "fu.h"
+#include "cache.h"
+
+const char *fu_names[FU_CLASSES] = {"add", "mul", "div", "mem", "branch"};
+
+// size the units and timing wheel from cpu->config
+int fu_alloc(CPU *cpu)
+{
+    FUPool *pool;
+    int units = 0;
+    int longest = 0;
+    int outcomes = 0;
+
+    fu_free(cpu);
+    pool = calloc(1, sizeof(FUPool));
+    if (!pool)
+    {
+        return -1;
+    }
+    cpu->fu_pool = pool;
+    for (int fu = 0; fu < FU_CLASSES; fu++)
+    {
+        pool->first[fu] = units;
+        units += CONFIG(cpu, fu[fu].count);
+        if (CONFIG(cpu, fu[fu].latency) > longest)
+        {
+            longest = CONFIG(cpu, fu[fu].latency);
+        }
+    }
+    pool->first[FU_CLASSES] = units;
+    // a load may add a miss in every cache level to the mem latency, and
+    // loads issued to one unit in different cycles finish together when
+    // they end at different levels: a hit in each level, memory or forwarded
+    for (Cache *c = cpu->l1d; c; c = c->next)
+    {
+        outcomes++;
+    }
+    pool->wheel_size = longest + 1 + (cpu->l1d ? cache_worst_latency(cpu->l1d) : 0);
+    pool->slot_size = units + (outcomes ? outcomes + 1 : 0) * CONFIG(cpu, fu[FU_MEM].count);
+    pool->free_at = malloc(sizeof(long) * units);
+    pool->wheel = malloc(sizeof(int) * pool->wheel_size * pool->slot_size);
+    pool->wheel_count = malloc(sizeof(int) * pool->wheel_size);
+    if (!pool->free_at || !pool->wheel || !pool->wheel_count)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void fu_free(CPU *cpu)
+{
+    FUPool *pool = cpu->fu_pool;
+
+    if (!pool)
+    {
+        return;
+    }
+    free(pool->free_at);
+    free(pool->wheel);
+    free(pool->wheel_count);
+    free(pool);
+    cpu->fu_pool = NULL;
+}
+
+// drop everything in execution, every unit is free
+void fu_reset(CPU *cpu)
+{
+    FUPool *pool = cpu->fu_pool;
+
+    for (int u = 0; u < pool->first[FU_CLASSES]; u++)
+    {
+        pool->free_at[u] = 0;
+    }
+    memset(pool->wheel_count, 0, sizeof(int) * pool->wheel_size);
+}
+
+// drop the uops younger than age from the wheel, their units stay busy
+void fu_squash(CPU *cpu, unsigned int age)
+{
+    FUPool *pool = cpu->fu_pool;
+
+    for (int slot = 0; slot < pool->wheel_size; slot++)
+    {
+        int *uops = pool->wheel + slot * pool->slot_size;
+        int kept = 0;
+        for (int i = 0; i < pool->wheel_count[slot]; i++)
+        {
+            if (cpu->uops[uops[i]].seq - cpu->uop_head <= age)
+            {
+                uops[kept++] = uops[i];
+            }
+        }
+        pool->wheel_count[slot] = kept;
+    }
+}
+
+// a unit of class fu that can take a uop this cycle, -1 if all are busy
+int fu_unit(CPU *cpu, int fu)
+{
+    FUPool *pool = cpu->fu_pool;
+
+    for (int u = pool->first[fu]; u < pool->first[fu + 1]; u++)
+    {
+        if (pool->free_at[u] <= cpu->clockCycle)
+        {
+            return u;
+        }
+    }
+    return -1;
+}
+
+// uop starts on unit this cycle and finishes after the class latency and
+// extra cycles, a cache access, that do not hold the unit
+void fu_start(CPU *cpu, int unit, int uop, int extra)
+{
+    FUPool *pool = cpu->fu_pool;
+    int fu = cpu->uops[uop].fu;
+    int latency = CONFIG(cpu, fu[fu].latency);
+    int busy = CONFIG(cpu, fu[fu].pipelined) ? CONFIG(cpu, fu[fu].interval) : latency;
+    int slot = (cpu->clockCycle + latency + extra) % pool->wheel_size;
+
+    assert(pool->wheel_count[slot] < pool->slot_size);
+    pool->free_at[unit] = cpu->clockCycle + busy;
+    pool->wheel[slot * pool->slot_size + pool->wheel_count[slot]++] = uop;
+    pool->stats[fu].issued++;
+    pool->stats[fu].busy_cycles += busy;
+}
+
+// end of cycle: uops finishing now move to the completion buffer
+void fu_finish(CPU *cpu)
+{
+    FUPool *pool = cpu->fu_pool;
+    int slot = cpu->clockCycle % pool->wheel_size;
+    int *uops = pool->wheel + slot * pool->slot_size;
+
+    for (int i = 0; i < pool->wheel_count[slot]; i++)
+    {
+        complete_uop(cpu, uops[i]);
+    }
+    pool->wheel_count[slot] = 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Description: Functional unit pool. Each class has a configured number of
+ *              units with a latency, an issue interval and a pipelined or
+ *              unpipelined mode. Uops in execution wait in a timing wheel
+ *              slot for the cycle they finish.
+ */
+
+#ifndef _FU_H_
+#define _FU_H_
+#include "cpu.h"
+
+typedef struct FUStats
+{
+    long issued;
+    long busy_cycles;           // unit-cycles a unit could not take a new uop
+    long structural_stalls;     // cycles a ready uop found every unit of its class busy
+} FUStats;
+
+typedef struct FUPool
+{
+    long *free_at;              // per unit, first cycle it takes a new uop
+    int first[FU_CLASSES + 1];  // class fu owns units first[fu] to first[fu + 1] - 1
+    int wheel_size;             // longest latency + 1 slots
+    int slot_size;              // uops one slot can hold, one per unit and load latency
+    int *wheel;                 // uop indices by the cycle they finish
+    int *wheel_count;
+    FUStats stats[FU_CLASSES];
+} FUPool;
+
+extern const char *fu_names[FU_CLASSES];
+
+int fu_alloc(CPU *cpu);
+
+void fu_free(CPU *cpu);
+
+void fu_reset(CPU *cpu);
+
+void fu_squash(CPU *cpu, unsigned int age);
+
+int fu_unit(CPU *cpu, int fu);
+
+void fu_start(CPU *cpu, int unit, int uop, int extra);
+
+void fu_finish(CPU *cpu);
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * Description: Functional model and right-path tracking.
+ *
+ * Fetch asks for one step per right-path instruction, in program order.
+ * A redirect caused by a right-path uop puts fetch back on the right path
+ * if it goes where the model went after that uop, a redirect caused by a
+ * wrong-path uop changes nothing. A replay fetches right-path instructions
+ * again, they take the steps already recorded instead of new ones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "functional.h"
+#include "cache.h"
+#include "predictor.h"
+
+// size the step ring, after cpu->uop_count is known
+int functional_alloc(CPU *cpu)
+{
+    FunctionalModel *f;
+
+    functional_free(cpu);
+    f = calloc(1, sizeof(FunctionalModel));
+    if (!f)
+    {
+        return -1;
+    }
+    cpu->functional = f;
+    f->steps = malloc(sizeof(PathStep) * cpu->uop_count);
+    return f->steps ? 0 : -1;
+}
+
+void functional_free(CPU *cpu)
+{
+    FunctionalModel *f = cpu->functional;
+
+    if (!f)
+    {
+        return;
+    }
+    for (int p = 0; p < FUNCTIONAL_PAGES; p++)
+    {
+        free(f->pages[p]);
+    }
+    free(f->steps);
+    free(f);
+    cpu->functional = NULL;
+}
+
+// words of data memory in page
+static int page_words(int page)
+{
+    int base = page << FUNCTIONAL_PAGE_SHIFT;
+    return MEMORY_SIZE - base < FUNCTIONAL_PAGE_WORDS ? MEMORY_SIZE - base : FUNCTIONAL_PAGE_WORDS;
+}
+
+// the model's copy of page, made from data_mem the first time it is
+// needed; NULL if out of memory
+int *functional_page(CPU *cpu, int page)
+{
+    FunctionalModel *f = cpu->functional;
+
+    if (!f->pages[page])
+    {
+        f->pages[page] = malloc(sizeof(int) * FUNCTIONAL_PAGE_WORDS);
+        if (f->pages[page])
+        {
+            memcpy(f->pages[page], cpu->data_mem + (page << FUNCTIONAL_PAGE_SHIFT), sizeof(int) * page_words(page));
+        }
+    }
+    return f->pages[page];
+}
+
+// the model reads page from data_mem again
+void functional_drop_page(CPU *cpu, int page)
+{
+    free(cpu->functional->pages[page]);
+    cpu->functional->pages[page] = NULL;
+}
+
+// start from the registers and data memory the pipeline starts from
+void functional_reset(CPU *cpu)
+{
+    FunctionalModel *f = cpu->functional;
+
+    for (int i = 0; i < REG_COUNT; i++)
+    {
+        f->regs[i] = cpu->regs[i].value;
+    }
+    for (int p = 0; p < FUNCTIONAL_PAGES; p++)
+    {
+        functional_drop_page(cpu, p);
+    }
+    f->pc = cpu->pc;
+    f->executed = 0;
+    f->step_count = f->cursor = 0;
+    f->wrong_path = false;
+}
+
+// execute inst, the instruction at f->pc, returns the next pc or -1 after
+// ret or a fault, which change nothing; memory instructions leave their
+// address in inst->addr, branches their direction in inst->result
+static int execute(CPU *cpu, FunctionalModel *f, Stage *inst)
+{
+    int *r = f->regs;
+    int next = f->pc + 1;
+
+    switch (inst->opcode)
+    {
+    case ADD:
+        r[inst->rd] = r[inst->rs1] + inst->imm;
+        break;
+    case SUB:
+        r[inst->rd] = r[inst->rs1] - inst->imm;
+        break;
+    case MUL:
+        r[inst->rd] = r[inst->rs1] * inst->imm;
+        break;
+    case ADDL:
+        r[inst->rd] = r[inst->rs1] + r[inst->rs2];
+        break;
+    case SUBL:
+        r[inst->rd] = r[inst->rs1] - r[inst->rs2];
+        break;
+    case MULL:
+        r[inst->rd] = r[inst->rs1] * r[inst->rs2];
+        break;
+    case DIV:
+    case DIVL:
+    {
+        int divisor = inst->opcode == DIV ? inst->imm : r[inst->rs2];
+        if (divisor == 0)
+        {
+            return -1;
+        }
+        r[inst->rd] = r[inst->rs1] / divisor;
+        break;
+    }
+    case SET:
+        r[inst->rd] = inst->imm;
+        break;
+    case LD:
+    case LDL:
+    case ST:
+    case STL:
+    {
+        inst->addr = inst->opcode == LD || inst->opcode == ST ? inst->imm : r[inst->rs1];
+        if (inst->addr < 0 || inst->addr / 4 >= MEMORY_SIZE)
+        {
+            return -1;
+        }
+        int word = inst->addr / 4;
+        int *page = f->pages[word >> FUNCTIONAL_PAGE_SHIFT];
+        if (inst->opcode == LD || inst->opcode == LDL)
+        {
+            r[inst->rd] = page ? page[word & (FUNCTIONAL_PAGE_WORDS - 1)] : cpu->data_mem[word];
+            break;
+        }
+        // the first store to a page copies it, out of memory stops the model
+        page = functional_page(cpu, word >> FUNCTIONAL_PAGE_SHIFT);
+        if (!page)
+        {
+            return -1;
+        }
+        page[word & (FUNCTIONAL_PAGE_WORDS - 1)] = r[inst->rd];
+        break;
+    }
+    case BEZ:
+    case BGEZ:
+    case BLEZ:
+    case BGTZ:
+    case BLTZ:
+    {
+        int a = r[inst->rd];
+        inst->result = inst->opcode == BEZ    ? a == 0
+                       : inst->opcode == BGEZ ? a >= 0
+                       : inst->opcode == BLEZ ? a <= 0
+                       : inst->opcode == BGTZ ? a > 0
+                                              : a < 0;
+        if (inst->result)
+        {
+            next = inst->imm / 4;
+        }
+        break;
+    }
+    case RET:
+        return -1;
+    }
+    return next;
+}
+
+// execute the instruction at f->pc, returns the next pc or -1 after ret,
+// a fault or the end of the program
+int functional_step(CPU *cpu, FunctionalModel *f)
+{
+    Stage inst;
+    int next;
+
+    if (f->pc < 0 || fetch_instruction(cpu, f->pc, &inst))
+    {
+        return f->pc = -1;
+    }
+    next = execute(cpu, f, &inst);
+    f->steps[f->step_count % cpu->uop_count] = (PathStep){f->pc, next};
+    f->step_count++;
+    f->executed++;
+    return f->pc = next;
+}
+
+// inst ran at full speed, the caches and predictor see it as the pipeline
+// would: instruction lines in fetch order, loads and stores, and branches
+// predicted then trained at once
+static void warm(CPU *cpu, Stage *inst, int *fetch_line)
+{
+    if (cpu->l1i && inst->pc * 4 >> cpu->l1i->line_shift != *fetch_line)
+    {
+        cache_read(cpu->l1i, inst->pc * 4);
+        *fetch_line = inst->pc * 4 >> cpu->l1i->line_shift;
+    }
+    if (cpu->l1d && inst->fu == FU_MEM)
+    {
+        if (inst->opcode == LD || inst->opcode == LDL)
+        {
+            cache_read(cpu->l1d, inst->addr);
+        }
+        else
+        {
+            cache_write(cpu->l1d, inst->addr);
+        }
+    }
+    if (IS_BRANCH(inst->opcode))
+    {
+        int target;
+        btb_lookup(cpu, inst->pc, &target);
+        predictor_predict(cpu, inst);
+        if (predictor_update(cpu, inst, inst->result))
+        {
+            predictor_recover(cpu, inst, inst->result);
+        }
+    }
+}
+
+// fast-forward: up to count instructions with no timing, stopping before
+// ret or an instruction that faults so the pipeline is the one to run it;
+// with warm_up the caches and predictor are trained on the way. Returns
+// the instructions run.
+long functional_run(CPU *cpu, long count, bool warm_up)
+{
+    FunctionalModel *f = cpu->functional;
+    Stage inst;
+    int fetch_line = -1;
+    long n;
+
+    for (n = 0; n < count; n++)
+    {
+        int next;
+        if (fetch_instruction(cpu, f->pc, &inst))
+        {
+            break;
+        }
+        next = execute(cpu, f, &inst);
+        if (next < 0)
+        {
+            break;
+        }
+        if (warm_up)
+        {
+            warm(cpu, &inst, &fetch_line);
+        }
+        f->pc = next;
+    }
+    f->executed += n;
+    return n;
+}
+
+// the pipeline takes over where the model stopped: registers, data memory
+// and pc become architectural, nothing is in flight. Only the pages the
+// model stored to are written back.
+void functional_handoff(CPU *cpu)
+{
+    FunctionalModel *f = cpu->functional;
+
+    for (int i = 0; i < REG_COUNT; i++)
+    {
+        cpu->regs[i].value = f->regs[i];
+    }
+    for (int p = 0; p < FUNCTIONAL_PAGES; p++)
+    {
+        int *page = f->pages[p];
+        int base = p << FUNCTIONAL_PAGE_SHIFT;
+        if (!page)
+        {
+            continue;
+        }
+        for (int i = page_words(p) - 1; i >= 0 && base + i >= cpu->memory_size; i--)
+        {
+            if (page[i] != cpu->data_mem[base + i])
+            {
+                cpu->memory_size = base + i + 1;
+                break;
+            }
+        }
+        memcpy(cpu->data_mem + base, page, sizeof(int) * page_words(p));
+        functional_drop_page(cpu, p);
+    }
+    cpu->pc = f->pc;
+    f->step_count = f->cursor = 0;
+    f->wrong_path = false;
+}
+
+// s was just fetched: on the right path it takes the next step, stepping
+// the model when fetch is ahead of it
+void path_fetch(CPU *cpu, Stage *s)
+{
+    FunctionalModel *f = cpu->functional;
+    PathStep *step;
+
+    s->wrong_path = f->wrong_path;
+    if (s->wrong_path)
+    {
+        cpu->wrong_path.fetched++;
+        cpu->wrong_path.branches += IS_BRANCH(s->opcode);
+        return;
+    }
+    if (f->cursor == f->step_count)
+    {
+        assert(f->pc == s->pc);
+        functional_step(cpu, f);
+    }
+    step = &f->steps[f->cursor % cpu->uop_count];
+    assert(step->pc == s->pc);
+    s->path = f->cursor++;
+    s->next_pc = step->next_pc;
+}
+
+// fetch goes on to pc after s
+void path_next(CPU *cpu, Stage *s, int pc)
+{
+    if (!s->wrong_path && pc != s->next_pc)
+    {
+        cpu->functional->wrong_path = true;
+    }
+}
+
+// s sent fetch to pc and everything fetched after s is gone
+void path_redirect(CPU *cpu, Stage *s, int pc)
+{
+    FunctionalModel *f = cpu->functional;
+
+    if (!s->wrong_path)
+    {
+        f->cursor = s->path + 1;
+        f->wrong_path = pc != s->next_pc;
+    }
+}
+
+// right-path s and everything after it are fetched again
+void path_refetch(CPU *cpu, Stage *s)
+{
+    cpu->functional->cursor = s->path;
+    cpu->functional->wrong_path = false;
+}
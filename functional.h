@@ -0,0 +1,65 @@
+/*
+ * Description: Functional model. It executes the program one instruction
+ *              at a time on its own registers and memory, ahead of the
+ *              pipeline: fetch steps it on every right-path instruction,
+ *              so the model knows where each of them really goes next and
+ *              fetch knows the moment it leaves the right path. A ring of
+ *              the steps taken covers the instructions in flight, for when
+ *              a replay fetches some of them again. The same model
+ *              fast-forwards the start of a program with no timing, then
+ *              hands its registers and memory to the pipeline. Its memory
+ *              is data memory seen through copy-on-write pages, only the
+ *              pages it stores to are copied.
+ */
+
+#ifndef _FUNCTIONAL_H_
+#define _FUNCTIONAL_H_
+#include "cpu.h"
+
+#define FUNCTIONAL_PAGE_SHIFT   10      // 1024-word pages
+#define FUNCTIONAL_PAGE_WORDS   (1 << FUNCTIONAL_PAGE_SHIFT)
+#define FUNCTIONAL_PAGES        ((MEMORY_SIZE + FUNCTIONAL_PAGE_WORDS - 1) >> FUNCTIONAL_PAGE_SHIFT)
+
+typedef struct PathStep
+{
+    int pc;
+    int next_pc;                // -1 after ret or a fault
+} PathStep;
+
+typedef struct FunctionalModel
+{
+    int pc;                     // next instruction to execute, -1 once halted
+    int regs[REG_COUNT];
+    int *pages[FUNCTIONAL_PAGES];   // right-path stores land here, NULL reads data_mem
+    long executed;
+    PathStep *steps;            // ring of uop_count steps
+    unsigned int step_count;    // steps executed
+    unsigned int cursor;        // step of the next right-path fetch
+    bool wrong_path;            // fetch is past a redirect that went the wrong way
+} FunctionalModel;
+
+int functional_alloc(CPU *cpu);
+
+void functional_free(CPU *cpu);
+
+void functional_reset(CPU *cpu);
+
+int *functional_page(CPU *cpu, int page);
+
+void functional_drop_page(CPU *cpu, int page);
+
+int functional_step(CPU *cpu, FunctionalModel *f);
+
+long functional_run(CPU *cpu, long count, bool warm_up);
+
+void functional_handoff(CPU *cpu);
+
+void path_fetch(CPU *cpu, Stage *s);
+
+void path_next(CPU *cpu, Stage *s, int pc);
+
+void path_redirect(CPU *cpu, Stage *s, int pc);
+
+void path_refetch(CPU *cpu, Stage *s);
+
+#endif
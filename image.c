@@ -0,0 +1,420 @@
+/*
+ * Description: Encoder, converter and mmap loader for binary program images.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cpu.h"
+#include "parser.h"
+#include "image.h"
+
+extern char *instructions[];
+
+// sign extend the low `bits` bits of value
+static int sign_extend(uint32_t value, int bits)
+{
+    uint32_t sign = 1u << (bits - 1);
+    return (int)((value ^ sign) - sign);
+}
+
+// pack a decoded instruction, fails when an operand does not fit its field
+int encode_instruction(const Instruction *inst, uint32_t *word, const char **why)
+{
+    uint32_t operands = 0;
+
+    switch (inst->opcode)
+    {
+    case MULL:
+    case ADDL:
+    case SUBL:
+    case DIVL:
+        operands = inst->rs1 | inst->rs2 << 4;
+        break;
+    case MUL:
+    case ADD:
+    case SUB:
+    case DIV:
+        if (inst->op1 < -2048 || inst->op1 > 2047)
+        {
+            *why = "immediate does not fit the 12-bit field (-2048..2047)";
+            return -1;
+        }
+        operands = inst->rs1 | ((uint32_t)inst->op1 & 0xFFF) << 4;
+        break;
+    case LDL:
+    case STL:
+        operands = inst->rs1;
+        break;
+    case SET:
+        if (inst->op1 < -32768 || inst->op1 > 32767)
+        {
+            *why = "immediate does not fit the 16-bit field (-32768..32767)";
+            return -1;
+        }
+        operands = (uint32_t)inst->op1 & 0xFFFF;
+        break;
+    case LD:
+    case ST:
+    case BEZ:
+    case BGEZ:
+    case BLEZ:
+    case BGTZ:
+    case BLTZ:
+        if (inst->op1 < 0 || inst->op1 > 65535)
+        {
+            *why = "address does not fit the 16-bit field (0..65535)";
+            return -1;
+        }
+        operands = (uint32_t)inst->op1;
+        break;
+    case RET:
+        break;
+    default:
+        *why = "unknown opcode";
+        return -1;
+    }
+
+    *word = (uint32_t)inst->opcode | (uint32_t)inst->rd << 8 | operands << 16;
+    return 0;
+}
+
+// reject a word whose opcode or destination register is out of range
+int check_word(uint32_t word, const char **why)
+{
+    if (WORD_OPCODE(word) > RET)
+    {
+        *why = "unknown opcode";
+        return -1;
+    }
+    if (WORD_RD(word) >= REG_COUNT)
+    {
+        *why = "register out of range";
+        return -1;
+    }
+    return 0;
+}
+
+// unpack a word into inst
+void decode_word(uint32_t word, int no, Instruction *inst)
+{
+    uint32_t operands = WORD_OPERANDS(word);
+
+    inst->instruction_no = no;
+    inst->opcode = WORD_OPCODE(word);
+    inst->rd = WORD_RD(word);
+    inst->rs1 = inst->rs2 = inst->op1 = 0;
+
+    switch (inst->opcode)
+    {
+    case MULL:
+    case ADDL:
+    case SUBL:
+    case DIVL:
+        inst->rs1 = operands & 0xF;
+        inst->rs2 = (operands >> 4) & 0xF;
+        break;
+    case MUL:
+    case ADD:
+    case SUB:
+    case DIV:
+        inst->rs1 = operands & 0xF;
+        inst->op1 = sign_extend(operands >> 4, 12);
+        break;
+    case LDL:
+    case STL:
+        inst->rs1 = operands & 0xF;
+        break;
+    case SET:
+        inst->op1 = sign_extend(operands, 16);
+        break;
+    case LD:
+    case ST:
+    case BEZ:
+    case BGEZ:
+    case BLEZ:
+    case BGTZ:
+    case BLTZ:
+        inst->op1 = (int)operands;
+        break;
+    }
+}
+
+// print inst back in the text program format
+void disassemble(const Instruction *inst, char *buffer, size_t size)
+{
+    int address = inst->instruction_no * 4;
+
+    if (inst->opcode < 0 || inst->opcode > RET)
+    {
+        snprintf(buffer, size, "%04d ??? opcode %d", address, inst->opcode);
+        return;
+    }
+    switch (inst->opcode)
+    {
+    case MUL:
+    case ADD:
+    case SUB:
+    case DIV:
+        snprintf(buffer, size, "%04d %s R%d R%d #%d", address, instructions[inst->opcode], inst->rd, inst->rs1, inst->op1);
+        break;
+    case MULL:
+    case ADDL:
+    case SUBL:
+    case DIVL:
+        // register forms share the base mnemonic in the text format
+        snprintf(buffer, size, "%04d %s R%d R%d R%d", address, instructions[inst->opcode - MULL], inst->rd, inst->rs1, inst->rs2);
+        break;
+    case LDL:
+    case STL:
+        snprintf(buffer, size, "%04d %s R%d R%d", address, instructions[inst->opcode - MULL], inst->rd, inst->rs1);
+        break;
+    case RET:
+        snprintf(buffer, size, "%04d ret", address);
+        break;
+    default:
+        snprintf(buffer, size, "%04d %s R%d #%d", address, instructions[inst->opcode], inst->rd, inst->op1);
+        break;
+    }
+}
+
+// check the magic without mapping the file
+int is_program_image(char *filename)
+{
+    char magic[4];
+    FILE *fp = fopen(filename, "rb");
+    int found;
+
+    if (!fp)
+    {
+        return FALSE;
+    }
+    found = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, IMAGE_MAGIC, 4) == 0;
+    fclose(fp);
+    return found;
+}
+
+// map an image read-only and validate its sections
+int image_open(char *filename, ProgramImage *image)
+{
+    struct stat st;
+    const ImageHeader *header;
+    const uint32_t *code;
+    const char *why;
+    int fd = open(filename, O_RDONLY);
+
+    memset(image, 0, sizeof(*image));
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Error opening program image: %s\n", filename);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(ImageHeader))
+    {
+        fprintf(stderr, "%s: error: truncated program image\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    image->length = st.st_size;
+    image->base = mmap(NULL, image->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image->base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping program image: %s\n", filename);
+        image->base = NULL;
+        return -1;
+    }
+
+    header = image->base;
+    if (memcmp(header->magic, IMAGE_MAGIC, 4) == 0 && header->byte_order != IMAGE_BYTE_ORDER)
+    {
+        fprintf(stderr, "%s: error: program image was written with a different byte order\n", filename);
+        image_close(image);
+        return -1;
+    }
+    if (memcmp(header->magic, IMAGE_MAGIC, 4) != 0 || header->version != IMAGE_VERSION)
+    {
+        fprintf(stderr, "%s: error: not a version %d program image\n", filename, IMAGE_VERSION);
+        image_close(image);
+        return -1;
+    }
+    if (header->code_count == 0 || header->code_offset % 4 ||
+        header->code_offset + (size_t)header->code_count * 4 > image->length ||
+        (header->symbol_offset && (header->symbol_offset % 4 ||
+            header->symbol_offset + (size_t)header->symbol_size > image->length ||
+            header->symbol_size < (size_t)header->code_count * 4)))
+    {
+        fprintf(stderr, "%s: error: corrupt program image\n", filename);
+        image_close(image);
+        return -1;
+    }
+
+    // every word must decode to an opcode and registers the pipeline can index
+    code = (const uint32_t *)((const char *)image->base + header->code_offset);
+    for (uint32_t i = 0; i < header->code_count; i++)
+    {
+        if (check_word(code[i], &why))
+        {
+            fprintf(stderr, "%s: error: word %u: %s\n", filename, i, why);
+            image_close(image);
+            return -1;
+        }
+    }
+
+    image->code = code;
+    image->code_count = header->code_count;
+    if (header->symbol_offset)
+    {
+        image->symbols = (const uint32_t *)((const char *)image->base + header->symbol_offset);
+        image->names = (const char *)(image->symbols + image->code_count);
+    }
+    return 0;
+}
+
+void image_close(ProgramImage *image)
+{
+    if (image->base)
+    {
+        munmap(image->base, image->length);
+    }
+    memset(image, 0, sizeof(*image));
+}
+
+// source text of the instruction at pc, NULL without a symbol section
+const char *image_symbol(const ProgramImage *image, int pc)
+{
+    if (!image->symbols || pc < 0 || pc >= image->code_count)
+    {
+        return NULL;
+    }
+    return image->names + image->symbols[pc];
+}
+
+// convert a text program to an image, optionally keeping the source lines
+int convert_program(char *text_file, char *image_file, int with_symbols)
+{
+    ImageHeader header;
+    Program *program;
+    Instruction inst;
+    uint32_t *words;
+    uint32_t *offsets = NULL;
+    uint32_t names_size = 0;
+    const char *why;
+    int size;
+    FILE *fp;
+
+    program = load_program(text_file);
+    if (!program)
+    {
+        return 1;
+    }
+    size = program->size;
+    words = malloc(sizeof(uint32_t) * size);
+    if (!words)
+    {
+        program_free(program);
+        return 1;
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        program_get(program, i, &inst);
+        if (encode_instruction(&inst, &words[i], &why))
+        {
+            fprintf(stderr, "%s: error: instruction %d \"%s\": %s\n", text_file, i, program_text(program, i), why);
+            free(words);
+            program_free(program);
+            return 1;
+        }
+    }
+
+    if (with_symbols)
+    {
+        offsets = malloc(sizeof(uint32_t) * size);
+        if (!offsets)
+        {
+            free(words);
+            program_free(program);
+            return 1;
+        }
+        for (int i = 0; i < size; i++)
+        {
+            offsets[i] = names_size;
+            names_size += strlen(program_text(program, i)) + 1;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, 4);
+    header.version = IMAGE_VERSION;
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.code_count = size;
+    header.code_offset = sizeof(header);
+    if (with_symbols)
+    {
+        header.symbol_offset = header.code_offset + size * 4;
+        header.symbol_size = size * 4 + names_size;
+    }
+
+    fp = fopen(image_file, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "Error opening image file: %s\n", image_file);
+        free(offsets);
+        free(words);
+        program_free(program);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(words, sizeof(uint32_t), size, fp);
+    if (with_symbols)
+    {
+        fwrite(offsets, sizeof(uint32_t), size, fp);
+        for (int i = 0; i < size; i++)
+        {
+            fwrite(program_text(program, i), 1, strlen(program_text(program, i)) + 1, fp);
+        }
+    }
+    if (fclose(fp))
+    {
+        fprintf(stderr, "Error writing image file: %s\n", image_file);
+        free(offsets);
+        free(words);
+        program_free(program);
+        return 1;
+    }
+
+    printf("%s: %d instructions, %u bytes of code%s\n", image_file, size, size * 4, with_symbols ? ", with symbols" : "");
+    free(offsets);
+    free(words);
+    program_free(program);
+    return 0;
+}
+
+// print an image back in the text program format
+int disassemble_image(char *image_file)
+{
+    ProgramImage image;
+    Instruction inst;
+    char text[64];
+
+    if (image_open(image_file, &image))
+    {
+        return 1;
+    }
+    for (int i = 0; i < image.code_count; i++)
+    {
+        decode_word(image.code[i], i, &inst);
+        disassemble(&inst, text, sizeof(text));
+        printf("%s\n", text);
+    }
+    image_close(&image);
+    return 0;
+}
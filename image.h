@@ -0,0 +1,81 @@
+/*
+ * Description: Pre-decoded binary program images. Each instruction is one
+ *              4B word (1B opcode, 1B destination, 2B operands) so an image
+ *              can be mapped read-only and fetched from without parsing.
+ */
+
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define IMAGE_MAGIC "SIMG"
+#define IMAGE_VERSION 1
+
+// written in host byte order, reads back as this value only on a host with the same order
+#define IMAGE_BYTE_ORDER 0x01020304
+
+/*
+ * File layout (host byte order, see byte_order):
+ *   ImageHeader
+ *   uint32_t code[code_count]
+ *   optional symbol section: uint32_t offsets[code_count] followed by
+ *   NUL-terminated source lines, offsets are relative to the end of the
+ *   offsets array
+ */
+typedef struct ImageHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t code_count;
+    uint32_t code_offset;
+    uint32_t symbol_offset;     // 0 when the image has no symbol section
+    uint32_t symbol_size;
+    uint32_t byte_order;        // IMAGE_BYTE_ORDER
+    uint32_t reserved;
+} ImageHeader;
+
+// a mapped image, shared read-only between every simulator using it
+typedef struct ProgramImage
+{
+    void *base;
+    size_t length;
+    const uint32_t *code;
+    int code_count;
+    const uint32_t *symbols;    // NULL without a symbol section
+    const char *names;
+} ProgramImage;
+
+/*
+ * Operand field (upper 2B of the word):
+ *   Rd Rs1 Rs2     bits 0-3 Rs1, bits 4-7 Rs2
+ *   Rd Rs1 #imm    bits 0-3 Rs1, bits 4-15 signed 12-bit immediate
+ *   Rd Rs1         bits 0-3 Rs1
+ *   Rd #imm        16-bit immediate, signed for set, unsigned addresses otherwise
+ */
+#define WORD_OPCODE(w)  ((int)((w) & 0xFF))
+#define WORD_RD(w)      ((int)(((w) >> 8) & 0xFF))
+#define WORD_OPERANDS(w) ((uint32_t)((w) >> 16))
+
+int encode_instruction(const Instruction *inst, uint32_t *word, const char **why);
+
+int check_word(uint32_t word, const char **why);
+
+void decode_word(uint32_t word, int no, Instruction *inst);
+
+void disassemble(const Instruction *inst, char *buffer, size_t size);
+
+int is_program_image(char *filename);
+
+int image_open(char *filename, ProgramImage *image);
+
+void image_close(ProgramImage *image);
+
+const char *image_symbol(const ProgramImage *image, int pc);
+
+int convert_program(char *text_file, char *image_file, int with_symbols);
+
+int disassemble_image(char *image_file);
+
+#endif
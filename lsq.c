@@ -0,0 +1,206 @@
+/*
+ * Description: Load and store queues.
+ *
+ * A memory-order violation is found when a store executes: a younger load
+ * to the same word that has already executed and did not take its value
+ * from this store or a younger one read a stale value. The load is marked
+ * for replay, and when it reaches the ROB head it and everything after it
+ * are squashed and fetched again.
+ */
+
+#include <stdlib.h>
+#include "cpu.h"
+#include "lsq.h"
+#include "cache.h"
+
+#define IS_LOAD(opcode)  ((opcode) == LD || (opcode) == LDL)
+#define IS_STORE(opcode) ((opcode) == ST || (opcode) == STL)
+
+// position of uop in flight, smaller is older
+#define AGE(cpu, uop) ((cpu)->uops[uop].seq - (cpu)->uop_head)
+
+static int queue_alloc(LSQueue *q, int size)
+{
+    q->size = size;
+    q->entries = malloc(sizeof(LSQEntry) * size);
+    return q->entries ? 0 : -1;
+}
+
+// size the queues from cpu->config
+int lsq_alloc(CPU *cpu)
+{
+    LSQ *lsq;
+
+    lsq_free(cpu);
+    lsq = calloc(1, sizeof(LSQ));
+    if (!lsq)
+    {
+        return -1;
+    }
+    cpu->lsq = lsq;
+    if (queue_alloc(&lsq->loads, CONFIG(cpu, lq_size)) || queue_alloc(&lsq->stores, CONFIG(cpu, sq_size)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void lsq_free(CPU *cpu)
+{
+    LSQ *lsq = cpu->lsq;
+
+    if (!lsq)
+    {
+        return;
+    }
+    free(lsq->loads.entries);
+    free(lsq->stores.entries);
+    free(lsq);
+    cpu->lsq = NULL;
+}
+
+// drop every entry, nothing in flight
+void lsq_reset(CPU *cpu)
+{
+    cpu->lsq->loads.head = cpu->lsq->loads.count = 0;
+    cpu->lsq->stores.head = cpu->lsq->stores.count = 0;
+}
+
+// drop the entries younger than age, they sit at the tail of each queue
+void lsq_squash(CPU *cpu, unsigned int age)
+{
+    LSQueue *queues[] = {&cpu->lsq->loads, &cpu->lsq->stores};
+
+    for (int i = 0; i < 2; i++)
+    {
+        LSQueue *q = queues[i];
+        while (q->count && AGE(cpu, q->entries[(q->head + q->count - 1) % q->size].uop) > age)
+        {
+            q->count--;
+        }
+    }
+}
+
+// SLOT_USED if s finds room in its queue, else why it waits
+int lsq_check(CPU *cpu, Stage *s)
+{
+    LSQ *lsq = cpu->lsq;
+
+    if (IS_LOAD(s->opcode) && lsq->loads.count == lsq->loads.size)
+    {
+        return SLOT_LQ;
+    }
+    if (IS_STORE(s->opcode) && lsq->stores.count == lsq->stores.size)
+    {
+        return SLOT_SQ;
+    }
+    return SLOT_USED;
+}
+
+// memory instruction s enters its queue in program order
+void lsq_dispatch(CPU *cpu, Stage *s)
+{
+    LSQueue *q;
+    LSQEntry *e;
+
+    if (!IS_LOAD(s->opcode) && !IS_STORE(s->opcode))
+    {
+        return;
+    }
+    q = IS_LOAD(s->opcode) ? &cpu->lsq->loads : &cpu->lsq->stores;
+    s->lsq = (q->head + q->count++) % q->size;
+    e = &q->entries[s->lsq];
+    e->uop = s->seq & (cpu->uop_count - 1);
+    e->executed = false;
+    e->forwarded = false;
+}
+
+// value of load s at its address: the youngest older store to the same
+// word, else memory, which holds every committed store; *latency is the
+// data cache access time, 0 when forwarded
+int lsq_load(CPU *cpu, Stage *s, int *latency)
+{
+    LSQ *lsq = cpu->lsq;
+    LSQueue *q = &lsq->stores;
+    LSQEntry *load = &lsq->loads.entries[s->lsq];
+    unsigned int age = s->seq - cpu->uop_head;
+    bool unknown = false;
+
+    load->addr = s->addr / 4;
+    load->executed = true;
+    load->forwarded = false;
+    lsq->stats.loads++;
+    *latency = 0;
+    for (int i = q->count - 1; i >= 0; i--)
+    {
+        LSQEntry *e = &q->entries[(q->head + i) % q->size];
+        if (AGE(cpu, e->uop) > age)
+        {
+            continue;   // younger store
+        }
+        if (!e->executed)
+        {
+            unknown = true;
+        }
+        else if (e->addr == load->addr)
+        {
+            load->forwarded = true;
+            load->source = cpu->uops[e->uop].seq;
+            lsq->stats.forwarded++;
+            lsq->stats.speculated += unknown;
+            return e->value;
+        }
+    }
+    lsq->stats.speculated += unknown;
+    cpu->wrong_path.memory_reads += s->wrong_path;
+    if (cpu->l1d)
+    {
+        *latency = cache_read(cpu->l1d, s->addr);
+    }
+    return cpu->data_mem[load->addr];
+}
+
+// store s has its address and value, younger loads of the same word that
+// read it too early are replayed
+void lsq_store(CPU *cpu, Stage *s)
+{
+    LSQ *lsq = cpu->lsq;
+    LSQueue *q = &lsq->loads;
+    LSQEntry *store = &lsq->stores.entries[s->lsq];
+    unsigned int age = s->seq - cpu->uop_head;
+
+    store->addr = s->addr / 4;
+    store->value = s->src1_value;
+    store->executed = true;
+    lsq->stats.stores++;
+    for (int i = 0; i < q->count; i++)
+    {
+        LSQEntry *e = &q->entries[(q->head + i) % q->size];
+        Stage *load = &cpu->uops[e->uop];
+        if (AGE(cpu, e->uop) < age || !e->executed || e->addr != store->addr || load->replay)
+        {
+            continue;
+        }
+        if (!e->forwarded || e->source - cpu->uop_head < age)
+        {
+            // took memory or a store older than this one
+            load->replay = true;
+            lsq->stats.violations++;
+        }
+    }
+}
+
+// s leaves the ROB, it is the oldest entry of its queue
+void lsq_commit(CPU *cpu, Stage *s)
+{
+    LSQueue *q;
+
+    if (!IS_LOAD(s->opcode) && !IS_STORE(s->opcode))
+    {
+        return;
+    }
+    q = IS_LOAD(s->opcode) ? &cpu->lsq->loads : &cpu->lsq->stores;
+    assert(s->lsq == q->head);
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+}
@@ -0,0 +1,68 @@
+/*
+ * Description: Load and store queues. Memory instructions take an entry in
+ *              program order at dispatch. A load searches the older stores
+ *              for its address and takes the value of the youngest match,
+ *              or reads memory through the data cache, without waiting for
+ *              stores whose address is still unknown. A store that executes
+ *              later checks the younger loads, and one that read its address
+ *              too early is replayed. Stores write memory when they commit.
+ */
+
+#ifndef _LSQ_H_
+#define _LSQ_H_
+#include "cpu.h"
+
+typedef struct LSQStats
+{
+    long loads;
+    long stores;
+    long forwarded;             // loads that took the value of an older store
+    long speculated;            // loads that went ahead of an older store with an unknown address
+    long violations;            // of which read a stale value and were replayed
+} LSQStats;
+
+typedef struct LSQEntry
+{
+    int uop;                    // pool index
+    int addr;                   // word address once executed
+    int value;                  // stores: the value to write
+    bool executed;
+    bool forwarded;             // loads: value came from a store, not memory
+    unsigned int source;        // loads: seq of that store
+} LSQEntry;
+
+// ring of entries in program order, head is the oldest
+typedef struct LSQueue
+{
+    LSQEntry *entries;
+    int size;
+    int head;
+    int count;
+} LSQueue;
+
+typedef struct LSQ
+{
+    LSQueue loads;
+    LSQueue stores;
+    LSQStats stats;
+} LSQ;
+
+int lsq_alloc(CPU *cpu);
+
+void lsq_free(CPU *cpu);
+
+void lsq_reset(CPU *cpu);
+
+void lsq_squash(CPU *cpu, unsigned int age);
+
+int lsq_check(CPU *cpu, Stage *s);
+
+void lsq_dispatch(CPU *cpu, Stage *s);
+
+int lsq_load(CPU *cpu, Stage *s, int *latency);
+
+void lsq_store(CPU *cpu, Stage *s);
+
+void lsq_commit(CPU *cpu, Stage *s);
+
+#endif
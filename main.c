@@ -16,24 +16,97 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpu.h"
+#include "batch.h"
+#include "bench.h"
+#include "sweep.h"
+#include "sample.h"
+#include "image.h"
+#include "memory.h"
+#include "trace.h"
+#include "options.h"
 
 int binary_flag;
 
-void run_cpu_fun(char* filename){
+int run_cpu_fun(CPU *cpu, char* filename){
 
-    CPU *cpu = CPU_init();
-    CPU_run(cpu, filename);
+    int status = CPU_run(cpu, filename);
+    if (!status) {
+        CPU_print_stats(cpu);
+    }
     CPU_stop(cpu);
+    return status;
 }
 
-int main(int argc, const char * argv[]) {
+int main(int argc, char * argv[]) {
     if (argc<=1) {
         fprintf(stderr, "Error : missing required args\n");
+        usage(argv[0]);
         return -1;
     }
-    char* filename = (char*)argv[1];
-    
-    run_cpu_fun(filename);
+    if (strcmp(argv[1], "--bench-parse") == 0) {
+        return bench_parser(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    if (strcmp(argv[1], "--batch") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return -1;
+        }
+        int threads = argc > 4 && strcmp(argv[3], "-j") == 0 ? atoi(argv[4]) : 0;
+        return run_batch(argv[2], threads);
+    }
+    if (strcmp(argv[1], "--sweep") == 0) {
+        return run_sweep(argc - 1, argv + 1);
+    }
+    if (strcmp(argv[1], "--sample") == 0) {
+        return run_sample(argc - 1, argv + 1);
+    }
+    if (strcmp(argv[1], "--print-config") == 0) {
+        CPUConfig config;
+        config_defaults(&config);
+        if (argc > 2 && config_load(&config, argv[2])) {
+            return -1;
+        }
+        config_write(&config, stdout);
+        return 0;
+    }
+    if (strcmp(argv[1], "--convert") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return -1;
+        }
+        int strip = argc > 4 && strcmp(argv[4], "--strip") == 0;
+        return convert_program(argv[2], argv[3], !strip);
+    }
+    if (strcmp(argv[1], "--convert-mem") == 0) {
+        if (argc < 4) {
+            usage(argv[0]);
+            return -1;
+        }
+        return convert_memory(argv[2], argv[3]);
+    }
+    if (strcmp(argv[1], "--disasm") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return -1;
+        }
+        return disassemble_image(argv[2]);
+    }
+    if (strcmp(argv[1], "--trace-print") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return -1;
+        }
+        return trace_print_binary(argv[2]);
+    }
+
+    CPU *cpu = CPU_init();
+    int first = parse_run_options(cpu, argc, argv);
+    if (first < 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    char* filename = argv[first];
+    trace_buffer_stdout(cpu->trace);
     
-    return 0;
+    return run_cpu_fun(cpu, filename) ? -1 : 0;
 }
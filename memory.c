@@ -0,0 +1,220 @@
+/*
+ * Description: Loading and dumping of data memory images.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "cpu.h"
+#include "memory.h"
+
+// reserve zeroed memory for the header and MEMORY_SIZE words
+static int memory_reserve(DataMemory *memory)
+{
+    memory->length = sizeof(MemoryHeader) + sizeof(int) * MEMORY_SIZE;
+    memory->base = mmap(NULL, memory->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory->base == MAP_FAILED)
+    {
+        memory->base = NULL;
+        return -1;
+    }
+    memory->words = (int *)((char *)memory->base + sizeof(MemoryHeader));
+    return 0;
+}
+
+// parse a text memory map ("0 0 17 ...") into memory->words
+static int memory_load_text(char *filename, int fd, size_t size, DataMemory *memory)
+{
+    char *text = malloc(size + 1);
+    char *p;
+    char *end;
+    int count = 0;
+
+    if (!text || read(fd, text, size) != (ssize_t)size)
+    {
+        fprintf(stderr, "Error reading memory map file: %s\n", filename);
+        free(text);
+        return -1;
+    }
+    text[size] = '\0';
+
+    for (p = text;; p = end)
+    {
+        long value = strtol(p, &end, 10);
+        if (end == p)
+        {
+            break;
+        }
+        if (count >= MEMORY_SIZE)
+        {
+            printf("Error: Address %x exceeds maximum memory size of %d\n", count, MEMORY_SIZE);
+            free(text);
+            return -1;
+        }
+        memory->words[count++] = (int)value;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+        p++;
+    }
+    if (*p)
+    {
+        fprintf(stderr, "%s: error: unexpected character '%c' after word %d\n", filename, *p, count);
+        free(text);
+        return -1;
+    }
+
+    memory->word_count = count;
+    free(text);
+    return 0;
+}
+
+// map a binary image copy-on-write, or parse a text memory map
+int memory_open(char *filename, DataMemory *memory)
+{
+    struct stat st;
+    MemoryHeader header;
+    int fd = open(filename, O_RDONLY);
+
+    memset(memory, 0, sizeof(*memory));
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        printf("Error opening memory map file: %s\n", filename);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (memory_reserve(memory))
+    {
+        close(fd);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, MEMORY_MAGIC, 4) != 0)
+    {
+        int status = memory_load_text(filename, fd, st.st_size, memory);
+        close(fd);
+        if (status)
+        {
+            memory_close(memory);
+        }
+        return status;
+    }
+
+    if (header.byte_order != MEMORY_BYTE_ORDER)
+    {
+        fprintf(stderr, "%s: error: memory image was written with a different byte order\n", filename);
+        close(fd);
+        memory_close(memory);
+        return -1;
+    }
+    if (header.version != MEMORY_VERSION || header.data_offset != sizeof(header) ||
+        header.word_count > MEMORY_SIZE || sizeof(header) + (size_t)header.word_count * 4 != (size_t)st.st_size)
+    {
+        fprintf(stderr, "%s: error: not a valid version %d memory image\n", filename, MEMORY_VERSION);
+        close(fd);
+        memory_close(memory);
+        return -1;
+    }
+
+    // the file replaces the front of the zeroed reservation, pages are only
+    // copied when the simulation writes to them
+    size_t length = sizeof(header) + (size_t)header.word_count * 4;
+    if (mmap(memory->base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping memory image: %s\n", filename);
+        close(fd);
+        memory_close(memory);
+        return -1;
+    }
+    close(fd);
+
+    memory->word_count = header.word_count;
+    return 0;
+}
+
+void memory_close(DataMemory *memory)
+{
+    if (memory->base)
+    {
+        munmap(memory->base, memory->length);
+    }
+    memset(memory, 0, sizeof(*memory));
+}
+
+// write words as a binary image in one call, or as text for *.txt names
+int memory_dump(char *filename, const int *words, int word_count)
+{
+    size_t name_len = strlen(filename);
+    MemoryHeader header;
+    struct iovec parts[2];
+    size_t total;
+    int fd;
+
+    if (name_len > 4 && strcmp(filename + name_len - 4, ".txt") == 0)
+    {
+        FILE *fp = fopen(filename, "w");
+        if (!fp)
+        {
+            printf("Error: could not open file %s\n", filename);
+            return -1;
+        }
+        for (int i = 0; i < word_count; i++)
+        {
+            fprintf(fp, "%d ", words[i]);
+        }
+        return fclose(fp) ? -1 : 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MEMORY_MAGIC, 4);
+    header.version = MEMORY_VERSION;
+    header.byte_order = MEMORY_BYTE_ORDER;
+    header.word_count = word_count;
+    header.data_offset = sizeof(header);
+
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = (void *)words;
+    parts[1].iov_len = sizeof(int) * word_count;
+    total = parts[0].iov_len + parts[1].iov_len;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        printf("Error: could not open file %s\n", filename);
+        return -1;
+    }
+    if (writev(fd, parts, 2) != (ssize_t)total)
+    {
+        fprintf(stderr, "Error writing memory image: %s\n", filename);
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
+
+// convert a text memory map to a binary image
+int convert_memory(char *text_file, char *image_file)
+{
+    DataMemory memory;
+    int status;
+
+    if (memory_open(text_file, &memory))
+    {
+        return 1;
+    }
+    status = memory_dump(image_file, memory.words, memory.word_count);
+    if (!status)
+    {
+        printf("%s: %d words\n", image_file, memory.word_count);
+    }
+    memory_close(&memory);
+    return status ? 1 : 0;
+}
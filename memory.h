@@ -0,0 +1,49 @@
+/*
+ * Description: Data memory images. Binary images are mapped copy-on-write
+ *              so the simulator starts without reading them, text memory
+ *              maps are still accepted and parsed in one pass.
+ */
+
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_MAGIC "SMEM"
+#define MEMORY_VERSION 1
+
+// written in host byte order, reads back as this value only on a host with the same order
+#define MEMORY_BYTE_ORDER 0x01020304
+
+/*
+ * File layout (host byte order, see byte_order):
+ *   MemoryHeader
+ *   int32_t words[word_count]     word i holds byte address 4*i
+ */
+typedef struct MemoryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t word_count;
+    uint32_t data_offset;
+    uint32_t byte_order;        // MEMORY_BYTE_ORDER
+} MemoryHeader;
+
+// simulated data memory, always MEMORY_SIZE words long
+typedef struct DataMemory
+{
+    void *base;
+    size_t length;
+    int *words;
+    int word_count;     // words present in the image
+} DataMemory;
+
+int memory_open(char *filename, DataMemory *memory);
+
+void memory_close(DataMemory *memory);
+
+int memory_dump(char *filename, const int *words, int word_count);
+
+int convert_memory(char *text_file, char *image_file);
+
+#endif
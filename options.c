@@ -0,0 +1,185 @@
+/*
+ * Description: Command line options of a simulation run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cpu.h"
+#include "trace.h"
+#include "options.h"
+#include "predictor.h"
+
+static struct option run_options[] = {
+    {"stream", required_argument, NULL, 's'},
+    {"memory", required_argument, NULL, 'm'},
+    {"dump", required_argument, NULL, 'o'},
+    {"quiet", no_argument, NULL, 'q'},
+    {"trace", required_argument, NULL, 't'},
+    {"trace-cats", required_argument, NULL, 'c'},
+    {"trace-window", required_argument, NULL, 'w'},
+    {"trace-bin", required_argument, NULL, 'b'},
+    {"trace-buffer", required_argument, NULL, 'B'},
+    {"max-cycles", required_argument, NULL, 'n'},
+    {"rob", required_argument, NULL, 'R'},
+    {"rs", required_argument, NULL, 'S'},
+    {"btb", required_argument, NULL, 'T'},
+    {"pt", required_argument, NULL, 'P'},
+    {"predictor", required_argument, NULL, 'D'},
+    {"config", required_argument, NULL, 'C'},
+    {"fast-forward", required_argument, NULL, 'F'},
+    {"warm", no_argument, NULL, 'W'},
+    {"checkpoint", required_argument, NULL, 'K'},
+    {"checkpoint-at", required_argument, NULL, 'A'},
+    {"restore", required_argument, NULL, 'r'},
+    {NULL, 0, NULL, 0}};
+
+void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [options] program\n", name);
+    fprintf(stderr, "  -m, --memory FILE     data memory image or text map (default memory_map.txt)\n");
+    fprintf(stderr, "  -o, --dump FILE       write final data memory, as text if FILE ends in .txt\n");
+    fprintf(stderr, "      --stream N        stream the program through an N-instruction window\n");
+    fprintf(stderr, "  -n, --max-cycles N    stop after N cycles\n");
+    fprintf(stderr, "      --fast-forward N  run the first N instructions functionally, then the pipeline\n");
+    fprintf(stderr, "      --warm            train the caches and predictor while fast-forwarding\n");
+    fprintf(stderr, "      --checkpoint FILE save the whole simulator state to FILE before cycle N\n");
+    fprintf(stderr, "      --checkpoint-at N (default 0, after any fast-forward)\n");
+    fprintf(stderr, "      --restore FILE    resume from a checkpoint, with the configuration it was taken with\n");
+    fprintf(stderr, "      --config FILE     microarchitecture INI file, see --print-config\n");
+    fprintf(stderr, "      --rob N, --rs N   reorder buffer and reservation station entries (default %d, %d)\n", ROB_SIZE, RS_SIZE);
+    fprintf(stderr, "      --btb N, --pt N   branch target buffer and pattern table entries (default %d, %d)\n", BTB_SIZE, PT_SIZE);
+    fprintf(stderr, "      --predictor NAME  bimodal, gshare, tournament or TAGE (default %s)\n", predictor_name(PREDICTOR));
+    fprintf(stderr, "  -q, --quiet           same as --trace off\n");
+    fprintf(stderr, "  -t, --trace LEVEL     off, summary, stage or full (default full)\n");
+    fprintf(stderr, "      --trace-cats LIST fetch,rs,exec,rob,pred,regs or all\n");
+    fprintf(stderr, "      --trace-window A:B only trace cycles A to B\n");
+    fprintf(stderr, "      --trace-bin FILE  log pipeline events to a binary trace\n");
+    fprintf(stderr, "      --trace-buffer N  binary trace ring size in records\n");
+    fprintf(stderr, "tools:\n");
+    fprintf(stderr, "  %s --batch jobs.txt [-j threads]\n", name);
+    fprintf(stderr, "  %s --sweep [--config F] [--rob L] [--rs L] [--btb L] [--pt L] [--predictor NAMES] [-m F] [-n N] [-j N] [--json] [-o F] program...\n", name);
+    fprintf(stderr, "      L is a list of N, A:B (doubling) or A:B:S (step S), e.g. --rob 4:64 --pt 16,32\n");
+    fprintf(stderr, "  %s --sample [--period N] [--interval N] [--warmup N] [--cold] [--config F] [--predictor NAME]\n"
+                    "      [-m F] [-j N] [-v] [--checkpoint-dir D] program\n", name);
+    fprintf(stderr, "      detailed intervals from periodic checkpoints on all host cores (default every %d\n"
+                    "      instructions, %d warmup and %d measured), IPC with a 95%% confidence interval\n",
+            1000000, 2000, 10000);
+    fprintf(stderr, "  %s --print-config [config.ini]\n", name);
+    fprintf(stderr, "  %s --convert program.txt program.img [--strip]\n", name);
+    fprintf(stderr, "  %s --convert-mem memory_map.txt memory.img\n", name);
+    fprintf(stderr, "  %s --disasm program.img\n", name);
+    fprintf(stderr, "  %s --trace-print trace.bin\n", name);
+    fprintf(stderr, "  %s --bench-parse [lines]\n", name);
+}
+
+// apply options to cpu, returns the index of the program argument or -1
+int parse_run_options(CPU *cpu, int argc, char **argv)
+{
+    Trace *trace = cpu->trace;
+    char *trace_file = NULL;
+    int trace_buffer = 0;
+    int opt;
+
+    // getopt keeps its position in globals, start over for every job
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, "m:o:qt:n:", run_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            cpu->stream_window = atoi(optarg);
+            break;
+        case 'm':
+            cpu->memory_file = optarg;
+            break;
+        case 'o':
+            cpu->dump_file = optarg;
+            break;
+        case 'q':
+            trace->level = TRACE_OFF;
+            break;
+        case 't':
+            if (trace_parse_level(optarg, &trace->level))
+            {
+                return -1;
+            }
+            break;
+        case 'c':
+            if (trace_parse_categories(optarg, &trace->categories))
+            {
+                return -1;
+            }
+            break;
+        case 'w':
+            if (trace_parse_window(optarg, &trace->start_cycle, &trace->end_cycle))
+            {
+                return -1;
+            }
+            break;
+        case 'b':
+            trace_file = optarg;
+            break;
+        case 'B':
+            trace_buffer = atoi(optarg);
+            break;
+        case 'n':
+            cpu->max_cycles = atol(optarg);
+            break;
+        case 'R':
+            cpu->config.rob_size = atoi(optarg);
+            break;
+        case 'S':
+            cpu->config.rs_size = atoi(optarg);
+            break;
+        case 'T':
+            cpu->config.btb_size = atoi(optarg);
+            break;
+        case 'P':
+            cpu->config.pt_size = atoi(optarg);
+            break;
+        case 'D':
+            cpu->config.predictor = predictor_parse(optarg, (int)strlen(optarg));
+            if (cpu->config.predictor < 0)
+            {
+                fprintf(stderr, "Error: unknown predictor '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'C':
+            if (config_load(&cpu->config, optarg))
+            {
+                return -1;
+            }
+            break;
+        case 'F':
+            cpu->fast_forward = atol(optarg);
+            break;
+        case 'W':
+            cpu->warm = TRUE;
+            break;
+        case 'K':
+            cpu->checkpoint_file = optarg;
+            break;
+        case 'A':
+            cpu->checkpoint_cycle = atol(optarg);
+            break;
+        case 'r':
+            cpu->restore_file = optarg;
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Error : missing program file\n");
+        return -1;
+    }
+    if (trace_file && trace_open_binary(trace, trace_file, trace_buffer))
+    {
+        return -1;
+    }
+    return optind;
+}
@@ -0,0 +1,14 @@
+/*
+ * Description: Command line options of a simulation run, shared by the
+ *              single run and by job lines of batch files.
+ */
+
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+#include "cpu.h"
+
+void usage(const char *name);
+
+int parse_run_options(CPU *cpu, int argc, char **argv);
+
+#endif
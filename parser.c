@@ -0,0 +1,672 @@
+/*
+ * Description: Single-pass, table-driven decoder for the text program format
+ *              ("0004 add R1 R2 #3"), plus the original regex decoder which
+ *              is only used as a baseline by the load-time benchmark.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <regex.h>
+#include "cpu.h"
+#include "parser.h"
+#include "program.h"
+
+// maping from opcode to string
+char *instructions[] = {"mul", "add", "sub", "div", "ld", "st", "mull", "addl", "subl", "divl", "ldl", "stl", "set", "bez", "bgez", "blez", "bgtz", "bltz", "ret"};
+
+// operand layouts that can follow a mnemonic
+#define FORM_RRX    0   // Rd Rs1 (Rs2 | #imm)
+#define FORM_RX     1   // Rd (Rs1 | #imm)
+#define FORM_RI     2   // Rd #imm
+#define FORM_NONE   3   // no operands
+
+// mnemonics are at most 4 letters, so they pack into a single word
+#define MNEMONIC_KEY(a, b, c, d) \
+    ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+typedef struct OpcodeEntry
+{
+    uint32_t key;
+    int form;
+    int imm_opcode;     // opcode when the last operand is an immediate
+    int reg_opcode;     // opcode when the last operand is a register
+} OpcodeEntry;
+
+static const OpcodeEntry opcode_table[] = {
+    {MNEMONIC_KEY('m', 'u', 'l', 0), FORM_RRX, MUL, MULL},
+    {MNEMONIC_KEY('a', 'd', 'd', 0), FORM_RRX, ADD, ADDL},
+    {MNEMONIC_KEY('s', 'u', 'b', 0), FORM_RRX, SUB, SUBL},
+    {MNEMONIC_KEY('d', 'i', 'v', 0), FORM_RRX, DIV, DIVL},
+    {MNEMONIC_KEY('l', 'd', 0, 0), FORM_RX, LD, LDL},
+    {MNEMONIC_KEY('s', 't', 0, 0), FORM_RX, ST, STL},
+    {MNEMONIC_KEY('s', 'e', 't', 0), FORM_RI, SET, -1},
+    {MNEMONIC_KEY('b', 'e', 'z', 0), FORM_RI, BEZ, -1},
+    {MNEMONIC_KEY('b', 'g', 'e', 'z'), FORM_RI, BGEZ, -1},
+    {MNEMONIC_KEY('b', 'l', 'e', 'z'), FORM_RI, BLEZ, -1},
+    {MNEMONIC_KEY('b', 'g', 't', 'z'), FORM_RI, BGTZ, -1},
+    {MNEMONIC_KEY('b', 'l', 't', 'z'), FORM_RI, BLTZ, -1},
+    {MNEMONIC_KEY('r', 'e', 't', 0), FORM_NONE, RET, -1},
+};
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// record the failing column and reason, always returns -1
+static int parse_fail(ParseError *err, const char *line, const char *at, const char *message)
+{
+    err->column = (int)(at - line) + 1;
+    snprintf(err->message, sizeof(err->message), "%s", message);
+    return -1;
+}
+
+// operands are separated from the previous token by at least one blank
+static int expect_separator(const char **p, ParseError *err, const char *line)
+{
+    if (!is_blank(**p))
+    {
+        return parse_fail(err, line, *p, **p ? "expected whitespace before operand" : "missing operand");
+    }
+    while (is_blank(**p))
+    {
+        (*p)++;
+    }
+    return 0;
+}
+
+// R0 - R15
+static int parse_register(const char **p, int *reg, ParseError *err, const char *line)
+{
+    const char *start = *p;
+    int value = 0;
+
+    if (**p != 'R')
+    {
+        return parse_fail(err, line, start, "expected register");
+    }
+    (*p)++;
+    if (!is_digit(**p))
+    {
+        return parse_fail(err, line, *p, "expected register number");
+    }
+    while (is_digit(**p))
+    {
+        value = value * 10 + (**p - '0');
+        if (value >= REG_COUNT)
+        {
+            return parse_fail(err, line, start, "register out of range (R0-R15)");
+        }
+        (*p)++;
+    }
+    *reg = value;
+    return 0;
+}
+
+// #imm, optionally negative, must fit in an int
+static int parse_immediate(const char **p, int *imm, ParseError *err, const char *line)
+{
+    const char *start = *p;
+    long long value = 0;
+    int negative = 0;
+
+    if (**p != '#')
+    {
+        return parse_fail(err, line, start, "expected immediate");
+    }
+    (*p)++;
+    if (**p == '-')
+    {
+        negative = 1;
+        (*p)++;
+    }
+    if (!is_digit(**p))
+    {
+        return parse_fail(err, line, *p, "expected digits after '#'");
+    }
+    while (is_digit(**p))
+    {
+        value = value * 10 + (**p - '0');
+        if (value > (long long)INT_MAX + negative)
+        {
+            return parse_fail(err, line, start, "immediate out of range");
+        }
+        (*p)++;
+    }
+    *imm = (int)(negative ? -value : value);
+    return 0;
+}
+
+// parse the given instruction in a single pass over the line
+int parse_instructions(Instruction *instr, char *line, int no, ParseError *err)
+{
+    const char *p = line;
+    const char *start;
+    const OpcodeEntry *entry = NULL;
+    uint32_t key = 0;
+    int length = 0;
+    int reg;
+
+    instr->instruction_no = no;
+    instr->rd = instr->rs1 = instr->rs2 = instr->op1 = 0;
+
+    while (is_blank(*p))
+    {
+        p++;
+    }
+
+    // optional instruction address in front of the mnemonic
+    if (is_digit(*p))
+    {
+        while (is_digit(*p))
+        {
+            p++;
+        }
+        if (!is_blank(*p))
+        {
+            return parse_fail(err, line, p, "expected whitespace after instruction address");
+        }
+        while (is_blank(*p))
+        {
+            p++;
+        }
+    }
+
+    start = p;
+    while (*p >= 'a' && *p <= 'z')
+    {
+        if (length < 4)
+        {
+            key |= (uint32_t)*p << (8 * length);
+        }
+        length++;
+        p++;
+    }
+    if (length == 0)
+    {
+        return parse_fail(err, line, start, "expected mnemonic");
+    }
+    if (length <= 4)
+    {
+        for (int i = 0; i < ARRLEN(opcode_table); i++)
+        {
+            if (opcode_table[i].key == key)
+            {
+                entry = &opcode_table[i];
+                break;
+            }
+        }
+    }
+    if (!entry)
+    {
+        return parse_fail(err, line, start, "unknown mnemonic");
+    }
+
+    instr->opcode = entry->imm_opcode;
+    if (entry->form != FORM_NONE)
+    {
+        if (expect_separator(&p, err, line) || parse_register(&p, &instr->rd, err, line))
+        {
+            return -1;
+        }
+    }
+
+    switch (entry->form)
+    {
+    case FORM_RRX:
+        if (expect_separator(&p, err, line) || parse_register(&p, &instr->rs1, err, line) ||
+            expect_separator(&p, err, line))
+        {
+            return -1;
+        }
+        if (*p == 'R')
+        {
+            instr->opcode = entry->reg_opcode;
+            if (parse_register(&p, &instr->rs2, err, line))
+            {
+                return -1;
+            }
+        }
+        else if (*p == '#')
+        {
+            if (parse_immediate(&p, &instr->op1, err, line))
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return parse_fail(err, line, p, "expected register or immediate");
+        }
+        break;
+    case FORM_RX:
+        if (expect_separator(&p, err, line))
+        {
+            return -1;
+        }
+        if (*p == 'R')
+        {
+            instr->opcode = entry->reg_opcode;
+            if (parse_register(&p, &reg, err, line))
+            {
+                return -1;
+            }
+            instr->rs1 = reg;
+        }
+        else if (*p == '#')
+        {
+            if (parse_immediate(&p, &instr->op1, err, line))
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return parse_fail(err, line, p, "expected register or immediate");
+        }
+        break;
+    case FORM_RI:
+        if (expect_separator(&p, err, line) || parse_immediate(&p, &instr->op1, err, line))
+        {
+            return -1;
+        }
+        break;
+    }
+
+    while (is_blank(*p))
+    {
+        p++;
+    }
+    if (*p)
+    {
+        return parse_fail(err, line, p, "unexpected characters after instruction");
+    }
+    return 0;
+}
+
+// print "file:line:col: error: ..." followed by the line and a caret
+void report_parse_error(const char *filename, const char *line, ParseError *err)
+{
+    fprintf(stderr, "%s:%d:%d: error: %s\n", filename, err->line, err->column, err->message);
+    fprintf(stderr, "    %s\n", line);
+    fprintf(stderr, "    %*s^\n", err->column - 1, "");
+}
+
+// Load a program from the specified file, the file buffer becomes its text
+// table. Errors are reported here and return NULL.
+Program *load_program(char *filename)
+{
+    FILE *fp;
+    long file_size;
+    char *buffer;
+    char *line;
+    char *end;
+    int mem_size = 1;
+    int curr_instr = 0;
+    int line_no = 0;
+    Program *program;
+    Instruction inst;
+    ParseError err;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "Error opening program file: %s\n", filename);
+        return NULL;
+    }
+
+    // read the whole file once and decode it in place
+    fseek(fp, 0, SEEK_END);
+    file_size = ftell(fp);
+    rewind(fp);
+    buffer = malloc(file_size + 1);
+    if (!buffer || fread(buffer, 1, file_size, fp) != (size_t)file_size)
+    {
+        fprintf(stderr, "Error reading program file: %s\n", filename);
+        free(buffer);
+        fclose(fp);
+        return NULL;
+    }
+    buffer[file_size] = '\0';
+    fclose(fp);
+
+    for (line = buffer; (line = memchr(line, '\n', buffer + file_size - line)); line++)
+    {
+        mem_size++;
+    }
+
+    program = program_create(mem_size);
+    if (!program)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    for (line = buffer; line < buffer + file_size; line = end + 1)
+    {
+        end = memchr(line, '\n', buffer + file_size - line);
+        if (!end)
+        {
+            end = buffer + file_size;
+        }
+        *end = '\0';
+        line_no++;
+
+        // blank lines do not take an instruction slot
+        char *p = line;
+        while (is_blank(*p))
+        {
+            p++;
+        }
+        if (!*p)
+        {
+            continue;
+        }
+
+        if (parse_instructions(&inst, line, curr_instr, &err))
+        {
+            err.line = line_no;
+            report_parse_error(filename, line, &err);
+            program_free(program);
+            free(buffer);
+            return NULL;
+        }
+        program_set(program, curr_instr, &inst);
+
+        // the trimmed line stays in the buffer as the display text
+        for (p = end; p > line && is_blank(p[-1]); p--)
+        {
+        }
+        *p = '\0';
+        program->text_offset[curr_instr] = (uint32_t)(line - buffer);
+        curr_instr++;
+    }
+
+    program->text = buffer;
+    program->size = curr_instr;
+    if (!curr_instr)
+    {
+        fprintf(stderr, "%s: error: program has no instructions\n", filename);
+        program_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+// =================== REGEX DECODER ===============================
+
+// regex to check the opcode
+char *instruction_id_regex = "(mul)|(add)|(sub)|(div)|(ld)|(st)|(mull)|(addl)|(subl)|(divl)|(ldl)|(stl)|(set)|(bez)|(bgez)|(blez)|(bgtz)|(bltz)|(ret)";
+
+// specific regex to parse the instruction
+char *instruction_regex[] = {
+    "^[0-9]+ mul R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ add R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ sub R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ div R([0-9]+) R(-?[0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ ld R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ st R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ mul R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ add R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ sub R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ div R([0-9]+) R(-?[0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ ld R([0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ st R([0-9]+) R(-?[0-9]+)",
+    "^[0-9]+ set R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ bez R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ bgez R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ blez R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ bgtz R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ bltz R([0-9]+) #(-?[0-9]+)",
+    "^[0-9]+ ret"};
+
+// initialise regex parser for compiled instructions
+void initilize_parser(RegexDecoder *decoder)
+{
+    // compile the regex for instruction IDs
+    if (regcomp(&decoder->id, instruction_id_regex, REG_EXTENDED))
+    {
+        printf("Could not compile regular expression.\n");
+        exit(EXIT_FAILURE);
+    };
+
+    // loop through all instructions and compile their regexes
+    for (int i = 0; i < ARRLEN(instruction_regex); i++)
+    {
+        // compile the regex for the current instruction
+        if (regcomp(&decoder->forms[i], instruction_regex[i], REG_EXTENDED))
+        {
+            printf("Could not compile regular expression.\n");
+            exit(EXIT_FAILURE);
+        };
+    }
+}
+
+void free_parser(RegexDecoder *decoder)
+{
+    regfree(&decoder->id);
+    for (int i = 0; i < ARRLEN(instruction_regex); i++)
+    {
+        regfree(&decoder->forms[i]);
+    }
+}
+
+// Load instructions from the specified file with the regex decoder
+Instruction *load_instructions_regex(RegexDecoder *decoder, char *filename, int *size)
+{
+    FILE *fp;
+    ssize_t nread;
+    size_t len = 0;
+    char *line = NULL;
+    int mem_size = 0;
+    int curr_instr = 0;
+    Instruction *code_memory;
+
+    if (!filename)
+        exit(EXIT_FAILURE);
+
+    fp = fopen(filename, "r");
+    if (!fp)
+        exit(EXIT_FAILURE);
+
+    while ((nread = getline(&line, &len, fp)) != -1)
+    {
+        mem_size++;
+    }
+
+    *size = mem_size;
+    if (!mem_size)
+    {
+        fclose(fp);
+        exit(EXIT_FAILURE);
+    }
+
+    code_memory = calloc(mem_size, sizeof(Instruction));
+    if (!code_memory)
+    {
+        fclose(fp);
+        exit(EXIT_FAILURE);
+    }
+
+    rewind(fp);
+
+    while ((nread = getline(&line, &len, fp)) != -1)
+    {
+        if (line[nread - 1] == '\n')
+        {
+            line[nread - 1] = '\0';
+        }
+        parse_instructions_regex(decoder, &code_memory[curr_instr], line, curr_instr);
+        curr_instr++;
+    }
+
+    free(line);
+    fclose(fp);
+    return code_memory;
+}
+
+// parse the given instructions
+void parse_instructions_regex(RegexDecoder *decoder, Instruction *instr, char *line, int no)
+{
+    instr->instruction_no = no;
+
+    char *cursor = line;
+    regmatch_t match[1];
+    int reg_compile;
+
+    // compile the line with regular expressions
+    reg_compile = regexec(&decoder->id, cursor, 1, match, 0);
+
+    if (reg_compile == REG_NOMATCH)
+    {
+        printf("Could not parse instruction %d: %s\n", no, line);
+        char error_message[100];
+        regerror(reg_compile, &decoder->id, error_message, sizeof(error_message));
+        printf("regexec failed: %s at position %d\n", error_message, (int)match[0].rm_so);
+        exit(EXIT_FAILURE);
+    }
+
+    char cursorCopy[strlen(cursor) + 1];
+    strcpy(cursorCopy, cursor);
+    cursorCopy[match[0].rm_eo] = 0;
+
+    // remove opcode from the string
+    memmove(cursorCopy, cursorCopy + 5, strlen(cursorCopy) - 5 + 1);
+    int has_register = has_two_R_letters(cursor, cursorCopy);
+
+    // get opcode index
+    instr->opcode = getIndex(instructions, ARRLEN(instructions), cursorCopy, has_register);
+
+    int group;
+    int maxGroups = 4;
+    int operands[3] = {0};
+    regmatch_t tokens[maxGroups];
+
+    if (regexec(&decoder->forms[instr->opcode], cursor, 4, tokens, 0))
+    {
+        printf("Could not parse instruction [%d: %s] of type [%d%s]\n", no, line, instr->opcode, cursorCopy + match[0].rm_so);
+        exit(EXIT_FAILURE);
+    }
+
+    for (group = 1; group < 4; group++)
+    {
+        if (tokens[group].rm_so == (size_t)-1)
+            break; // No more groups
+
+        char cursorCopy[strlen(cursor) + 1];
+        strcpy(cursorCopy, cursor);
+        cursorCopy[tokens[group].rm_eo] = 0;
+        operands[group - 1] = atoi(cursorCopy + tokens[group].rm_so);
+    }
+
+    switch (instr->opcode)
+    {
+        case MUL:
+        case ADD:
+        case SUB:
+        case DIV:
+            instr->rd = operands[0];
+            instr->rs1 = operands[1];
+            instr->op1 = operands[2];
+            break;
+        case MULL:
+        case ADDL:
+        case SUBL:
+        case DIVL:
+            instr->rd = operands[0];
+            instr->rs1 = operands[1];
+            instr->rs2 = operands[2];
+            break;
+        case SET:
+        case LD:
+        case ST:
+        case BEZ:
+        case BGEZ:
+        case BLEZ:
+        case BGTZ:
+        case BLTZ:
+            instr->rd = operands[0];
+            instr->op1 = operands[1];
+            break;
+        case LDL:
+        case STL:
+            instr->rd = operands[0];
+            instr->rs1 = operands[1];
+            break;
+    }
+}
+
+// check if the instruction has two R's
+int has_two_R_letters(char *str, char *code)
+{
+    int count = 0;
+    // Iterate through the string and count the number of 'R' letters.
+    // If two 'R' letters are found, return TRUE.
+    if (strcmp(code, "st") == 0 || strcmp(code, "ld") == 0)
+    {
+        for (int i = 0; str[i] != '\0'; i++)
+        {
+            if (str[i] == 'R')
+            {
+                count++;
+                if (count == 2)
+                {
+                    return TRUE;
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; str[i] != '\0'; i++)
+        {
+            if (str[i] == 'R')
+            {
+                count++;
+                if (count == 3)
+                {
+                    return TRUE;
+                }
+            }
+        }
+    }
+    // If the string does not contain two 'R' letters, return FALSE.
+    return FALSE;
+}
+
+int getIndex(char **arr, int len, char *inst, int has_register)
+{
+    // If the instruction requires a register, append 'l' to the instruction string.
+    // Note that the 'l' character is only appended to the instruction string if the instruction
+    // is not "set" or "ret", as these two instructions do not require a register.
+    if (has_register)
+    {
+        if (strcmp(inst, "set") != 0 && strcmp(inst, "ret") != 0)
+        {
+            strcat(inst, "l");
+        }
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if (strcmp(arr[i], inst) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Description: Instruction decoder for the text program format. The table
+ *              driven decoder is the one used by the simulator; the regex
+ *              decoder is kept as a reference for load-time benchmarks.
+ */
+
+#ifndef _PARSER_H_
+#define _PARSER_H_
+#include <regex.h>
+#include "cpu.h"
+#include "program.h"
+
+// position and reason of a decode failure
+typedef struct ParseError
+{
+    int line;
+    int column;
+    char message[96];
+} ParseError;
+
+int parse_instructions(Instruction *instr, char *line, int no, ParseError *err);
+
+void report_parse_error(const char *filename, const char *line, ParseError *err);
+
+Program *load_program(char *filename);
+
+// ---------------- regex decoder (reference only) -----------------
+
+// compiled patterns, one per opcode
+typedef struct RegexDecoder
+{
+    regex_t id;
+    regex_t forms[RET + 1];
+} RegexDecoder;
+
+void initilize_parser(RegexDecoder *decoder);
+
+void free_parser(RegexDecoder *decoder);
+
+int has_two_R_letters(char *str, char *code);
+
+int getIndex(char **arr, int len, char *inst, int has_register);
+
+void parse_instructions_regex(RegexDecoder *decoder, Instruction *instr, char *line, int no);
+
+Instruction *load_instructions_regex(RegexDecoder *decoder, char *filename, int *size);
+
+#endif
@@ -0,0 +1,784 @@
+/*
+ * Description: Branch direction predictors and the branch target buffer.
+ *
+ * Every predictor indexes tables of saturating counters, the ones with
+ * history differ in how they mix it with the pc. History is shifted at
+ * predict time so branches fetched back to back see each other, and the
+ * history a branch was predicted with travels with it in the uop so
+ * commit can train the same entries and a redirect can rebuild it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cpu.h"
+#include "predictor.h"
+#include "checkpoint.h"
+
+// bits to index size entries
+static int index_bits(int size)
+{
+    int bits = 0;
+
+    while ((1 << bits) < size)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+static int counter_update(int counter, bool taken, int max)
+{
+    if (taken)
+    {
+        return counter < max ? counter + 1 : counter;
+    }
+    return counter > 0 ? counter - 1 : counter;
+}
+
+// ================ Counter tables =================================
+
+typedef struct Counters
+{
+    int *counter;
+    int size;
+} Counters;
+
+static int counters_alloc(Counters *t, int size)
+{
+    t->size = size;
+    t->counter = malloc(sizeof(int) * size);
+    return t->counter ? 0 : -1;
+}
+
+static void counters_fill(Counters *t, int value)
+{
+    for (int i = 0; i < t->size; i++)
+    {
+        t->counter[i] = value;
+    }
+}
+
+static int bimodal_index(const Counters *t, int pc)
+{
+    return pc % t->size;
+}
+
+static int gshare_index(const Counters *t, int pc, uint64_t history)
+{
+    uint64_t x = (uint64_t)pc ^ history;
+
+    return (int)((x ^ (x >> 32)) % (unsigned int)t->size);
+}
+
+static void counters_print(const char *name, const Counters *t)
+{
+    for (int i = 0; i < t->size; i++)
+    {
+        printf("%s%d: [counter: %d]\n", name, i, t->counter[i]);
+    }
+}
+
+// ================ Bimodal and gshare =============================
+
+// one pattern table, indexed by pc alone or by pc xor history
+typedef struct TablePredictor
+{
+    Predictor base;
+    Counters pt;
+} TablePredictor;
+
+static int table_init(Predictor *p, const CPUConfig *config)
+{
+    return counters_alloc(&((TablePredictor *)p)->pt, config->pt_size);
+}
+
+static void table_reset(Predictor *p)
+{
+    counters_fill(&((TablePredictor *)p)->pt, p->counter_taken - 1);
+}
+
+static void table_destroy(Predictor *p)
+{
+    free(((TablePredictor *)p)->pt.counter);
+}
+
+static void table_state(Predictor *p, StateFile *f)
+{
+    Counters *pt = &((TablePredictor *)p)->pt;
+
+    STATE_ARRAY(f, pt->counter, pt->size);
+}
+
+static void table_print_state(const Predictor *p)
+{
+    counters_print("PT", &((const TablePredictor *)p)->pt);
+}
+
+static bool bimodal_predict(Predictor *p, int pc, uint64_t history)
+{
+    Counters *t = &((TablePredictor *)p)->pt;
+
+    (void)history;
+    return t->counter[bimodal_index(t, pc)] >= p->counter_taken;
+}
+
+static void bimodal_update(Predictor *p, int pc, uint64_t history, bool taken, bool predicted)
+{
+    Counters *t = &((TablePredictor *)p)->pt;
+    int i = bimodal_index(t, pc);
+
+    (void)history;
+    (void)predicted;
+    t->counter[i] = counter_update(t->counter[i], taken, p->counter_max);
+}
+
+static bool gshare_predict(Predictor *p, int pc, uint64_t history)
+{
+    Counters *t = &((TablePredictor *)p)->pt;
+
+    return t->counter[gshare_index(t, pc, history)] >= p->counter_taken;
+}
+
+static void gshare_update(Predictor *p, int pc, uint64_t history, bool taken, bool predicted)
+{
+    Counters *t = &((TablePredictor *)p)->pt;
+    int i = gshare_index(t, pc, history);
+
+    (void)predicted;
+    t->counter[i] = counter_update(t->counter[i], taken, p->counter_max);
+}
+
+// ================ Tournament =====================================
+
+// a bimodal and a gshare table, a per-pc 2-bit chooser picks between them
+// and moves toward whichever was right when they disagree
+typedef struct Tournament
+{
+    Predictor base;
+    Counters local;
+    Counters global;
+    Counters chooser;           // 2 and 3 pick the global table
+    long chose_global;
+    long disagreed;
+} Tournament;
+
+static int tournament_init(Predictor *p, const CPUConfig *config)
+{
+    Tournament *t = (Tournament *)p;
+
+    return counters_alloc(&t->local, config->pt_size) || counters_alloc(&t->global, config->pt_size) ||
+           counters_alloc(&t->chooser, config->pt_size);
+}
+
+static void tournament_reset(Predictor *p)
+{
+    Tournament *t = (Tournament *)p;
+
+    counters_fill(&t->local, p->counter_taken - 1);
+    counters_fill(&t->global, p->counter_taken - 1);
+    counters_fill(&t->chooser, 1);
+    t->chose_global = t->disagreed = 0;
+}
+
+static void tournament_destroy(Predictor *p)
+{
+    Tournament *t = (Tournament *)p;
+
+    free(t->local.counter);
+    free(t->global.counter);
+    free(t->chooser.counter);
+}
+
+static bool tournament_predict(Predictor *p, int pc, uint64_t history)
+{
+    Tournament *t = (Tournament *)p;
+
+    if (t->chooser.counter[bimodal_index(&t->chooser, pc)] >= 2)
+    {
+        return t->global.counter[gshare_index(&t->global, pc, history)] >= p->counter_taken;
+    }
+    return t->local.counter[bimodal_index(&t->local, pc)] >= p->counter_taken;
+}
+
+static void tournament_update(Predictor *p, int pc, uint64_t history, bool taken, bool predicted)
+{
+    Tournament *t = (Tournament *)p;
+    int *local = &t->local.counter[bimodal_index(&t->local, pc)];
+    int *global = &t->global.counter[gshare_index(&t->global, pc, history)];
+    int *chooser = &t->chooser.counter[bimodal_index(&t->chooser, pc)];
+    bool local_taken = *local >= p->counter_taken;
+    bool global_taken = *global >= p->counter_taken;
+
+    (void)predicted;
+    t->chose_global += *chooser >= 2;
+    if (local_taken != global_taken)
+    {
+        t->disagreed++;
+        *chooser = counter_update(*chooser, global_taken == taken, 3);
+    }
+    *local = counter_update(*local, taken, p->counter_max);
+    *global = counter_update(*global, taken, p->counter_max);
+}
+
+static void tournament_print_stats(const Predictor *p)
+{
+    const Tournament *t = (const Tournament *)p;
+
+    printf("  chooser picked gshare for %ld branches, tables disagreed on %ld\n", t->chose_global, t->disagreed);
+}
+
+static void tournament_clear_stats(Predictor *p)
+{
+    Tournament *t = (Tournament *)p;
+
+    t->chose_global = t->disagreed = 0;
+}
+
+static void tournament_state(Predictor *p, StateFile *f)
+{
+    Tournament *t = (Tournament *)p;
+
+    STATE_ARRAY(f, t->local.counter, t->local.size);
+    STATE_ARRAY(f, t->global.counter, t->global.size);
+    STATE_ARRAY(f, t->chooser.counter, t->chooser.size);
+    STATE(f, t->chose_global);
+    STATE(f, t->disagreed);
+}
+
+static void tournament_print_state(const Predictor *p)
+{
+    const Tournament *t = (const Tournament *)p;
+
+    for (int i = 0; i < t->local.size; i++)
+    {
+        printf("PT%d: [local: %d, global: %d, chooser: %d]\n", i, t->local.counter[i], t->global.counter[i],
+               t->chooser.counter[i]);
+    }
+}
+
+// ================ TAGE ===========================================
+
+#define TAGE_MIN_HISTORY    4
+#define TAGE_TAG_BITS       9
+#define TAGE_NO_TAG         0xFFFF      // never equal to a TAGE_TAG_BITS tag
+#define TAGE_COUNTER_MIN    (-4)        // 3-bit signed, taken from 0 up
+#define TAGE_COUNTER_MAX    3
+#define TAGE_USEFUL_MAX     3
+#define TAGE_AGING_PERIOD   (1 << 18)   // updates between halving every useful counter
+
+typedef struct TageEntry
+{
+    int8_t counter;
+    uint8_t useful;
+    uint16_t tag;
+} TageEntry;
+
+// a bimodal base and tables tagged with pc and history, table i looking
+// at the newest length[i] outcomes; the longest hit provides the prediction
+typedef struct Tage
+{
+    Predictor base;
+    Counters bimodal;
+    int tables;
+    int size;                   // entries per tagged table
+    int bits;                   // index bits of size
+    int length[TAGE_MAX_TABLES];
+    TageEntry *entry[TAGE_MAX_TABLES];
+    long updates;
+    long provided[TAGE_MAX_TABLES + 1];     // committed branches by provider, 0 the base
+    long allocations;
+    long allocation_failures;   // no entry free, useful counters decayed instead
+} Tage;
+
+// the newest length outcomes of history xor-folded into bits
+static unsigned int fold(uint64_t history, int length, int bits)
+{
+    unsigned int folded = 0;
+
+    if (length < 64)
+    {
+        history &= (1ull << length) - 1;
+    }
+    for (; history; history >>= bits)
+    {
+        folded ^= (unsigned int)(history & ((1u << bits) - 1));
+    }
+    return folded;
+}
+
+// r with r^steps == span
+static double geometric_ratio(double span, int steps)
+{
+    double low = 1.0;
+    double high = span;
+
+    for (int i = 0; i < 64; i++)
+    {
+        double mid = (low + high) / 2;
+        double x = 1.0;
+        for (int k = 0; k < steps; k++)
+        {
+            x *= mid;
+        }
+        if (x < span)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int tage_init(Predictor *p, const CPUConfig *config)
+{
+    Tage *t = (Tage *)p;
+    int longest = config->history_bits ? config->history_bits : 64;
+    int shortest = longest < TAGE_MIN_HISTORY ? 1 : TAGE_MIN_HISTORY;
+    double ratio = config->tage_tables > 1 ? geometric_ratio((double)longest / shortest, config->tage_tables - 1) : 1;
+    double length = config->tage_tables > 1 ? shortest : longest;
+
+    t->tables = config->tage_tables;
+    t->size = config->pt_size;
+    t->bits = index_bits(t->size);
+    for (int i = 0; i < t->tables; i++)
+    {
+        t->length[i] = (int)(length + 0.5);
+        if (i && t->length[i] <= t->length[i - 1])
+        {
+            t->length[i] = t->length[i - 1] + 1;
+        }
+        if (t->length[i] > longest)
+        {
+            t->length[i] = longest;
+        }
+        length *= ratio;
+        t->entry[i] = malloc(sizeof(TageEntry) * t->size);
+        if (!t->entry[i])
+        {
+            return -1;
+        }
+    }
+    return counters_alloc(&t->bimodal, config->pt_size);
+}
+
+static void tage_reset(Predictor *p)
+{
+    Tage *t = (Tage *)p;
+
+    counters_fill(&t->bimodal, p->counter_taken - 1);
+    for (int i = 0; i < t->tables; i++)
+    {
+        for (int j = 0; j < t->size; j++)
+        {
+            t->entry[i][j] = (TageEntry){0, 0, TAGE_NO_TAG};
+        }
+    }
+    t->updates = t->allocations = t->allocation_failures = 0;
+    memset(t->provided, 0, sizeof(t->provided));
+}
+
+static void tage_destroy(Predictor *p)
+{
+    Tage *t = (Tage *)p;
+
+    for (int i = 0; i < TAGE_MAX_TABLES; i++)
+    {
+        free(t->entry[i]);
+    }
+    free(t->bimodal.counter);
+}
+
+// entries of pc in every table and their tags; the provider is the longest
+// table that hits and the alternate the next one, -1 for the base
+static void tage_lookup(Tage *t, int pc, uint64_t history, int *index, int *tag, int *provider, int *alternate)
+{
+    unsigned int upc = (unsigned int)pc;
+
+    *provider = *alternate = -1;
+    for (int i = 0; i < t->tables; i++)
+    {
+        unsigned int hash = fold(history, t->length[i], t->bits > 0 ? t->bits : 1);
+        index[i] = (int)((upc ^ upc >> t->bits ^ hash) % (unsigned int)t->size);
+        tag[i] = (int)((upc ^ fold(history, t->length[i], TAGE_TAG_BITS) ^
+                        fold(history, t->length[i], TAGE_TAG_BITS - 1) << 1) & ((1u << TAGE_TAG_BITS) - 1));
+        if (t->entry[i][index[i]].tag == tag[i])
+        {
+            *alternate = *provider;
+            *provider = i;
+        }
+    }
+}
+
+static bool tage_taken(Tage *t, int pc, const int *index, int table)
+{
+    if (table < 0)
+    {
+        return t->bimodal.counter[bimodal_index(&t->bimodal, pc)] >= t->base.counter_taken;
+    }
+    return t->entry[table][index[table]].counter >= 0;
+}
+
+static bool tage_predict(Predictor *p, int pc, uint64_t history)
+{
+    Tage *t = (Tage *)p;
+    int index[TAGE_MAX_TABLES];
+    int tag[TAGE_MAX_TABLES];
+    int provider, alternate;
+
+    tage_lookup(t, pc, history, index, tag, &provider, &alternate);
+    return tage_taken(t, pc, index, provider);
+}
+
+static void tage_update(Predictor *p, int pc, uint64_t history, bool taken, bool predicted)
+{
+    Tage *t = (Tage *)p;
+    int index[TAGE_MAX_TABLES];
+    int tag[TAGE_MAX_TABLES];
+    int provider, alternate;
+
+    tage_lookup(t, pc, history, index, tag, &provider, &alternate);
+    t->provided[provider + 1]++;
+    if (provider < 0)
+    {
+        int *c = &t->bimodal.counter[bimodal_index(&t->bimodal, pc)];
+        *c = counter_update(*c, taken, p->counter_max);
+    }
+    else
+    {
+        TageEntry *e = &t->entry[provider][index[provider]];
+        bool provider_taken = e->counter >= 0;
+        if (provider_taken != tage_taken(t, pc, index, alternate))
+        {
+            // only an entry that beat the shorter history is useful
+            if (provider_taken == taken && e->useful < TAGE_USEFUL_MAX)
+            {
+                e->useful++;
+            }
+            else if (provider_taken != taken && e->useful > 0)
+            {
+                e->useful--;
+            }
+        }
+        if (taken && e->counter < TAGE_COUNTER_MAX)
+        {
+            e->counter++;
+        }
+        else if (!taken && e->counter > TAGE_COUNTER_MIN)
+        {
+            e->counter--;
+        }
+    }
+
+    // a mispredict claims an entry in a longer table, weakly toward the outcome
+    if (predicted != taken && provider < t->tables - 1)
+    {
+        int i;
+        for (i = provider + 1; i < t->tables && t->entry[i][index[i]].useful; i++)
+            ;
+        if (i < t->tables)
+        {
+            TageEntry *e = &t->entry[i][index[i]];
+            e->tag = (uint16_t)tag[i];
+            e->counter = taken ? 0 : -1;
+            e->useful = 0;
+            t->allocations++;
+        }
+        else
+        {
+            for (i = provider + 1; i < t->tables; i++)
+            {
+                t->entry[i][index[i]].useful--;
+            }
+            t->allocation_failures++;
+        }
+    }
+
+    if (++t->updates % TAGE_AGING_PERIOD == 0)
+    {
+        for (int i = 0; i < t->tables; i++)
+        {
+            for (int j = 0; j < t->size; j++)
+            {
+                t->entry[i][j].useful >>= 1;
+            }
+        }
+    }
+}
+
+static void tage_print_stats(const Predictor *p)
+{
+    const Tage *t = (const Tage *)p;
+
+    printf("  provider: base %ld", t->provided[0]);
+    for (int i = 0; i < t->tables; i++)
+    {
+        printf(", T%d (%d) %ld", i + 1, t->length[i], t->provided[i + 1]);
+    }
+    printf("\n  entries allocated %ld, no free entry %ld\n", t->allocations, t->allocation_failures);
+}
+
+static void tage_clear_stats(Predictor *p)
+{
+    Tage *t = (Tage *)p;
+
+    memset(t->provided, 0, sizeof(t->provided));
+    t->allocations = t->allocation_failures = 0;
+}
+
+static void tage_state(Predictor *p, StateFile *f)
+{
+    Tage *t = (Tage *)p;
+
+    STATE_ARRAY(f, t->bimodal.counter, t->bimodal.size);
+    for (int i = 0; i < t->tables; i++)
+    {
+        STATE_ARRAY(f, t->entry[i], t->size);
+    }
+    STATE(f, t->updates);
+    STATE(f, t->provided);
+    STATE(f, t->allocations);
+    STATE(f, t->allocation_failures);
+}
+
+// ================ Framework ======================================
+
+static const PredictorOps predictor_ops[PREDICTORS] = {
+    {"bimodal", sizeof(TablePredictor), table_init, table_reset, bimodal_predict, bimodal_update, NULL, NULL,
+     table_state, table_print_state, table_destroy},
+    {"gshare", sizeof(TablePredictor), table_init, table_reset, gshare_predict, gshare_update, NULL, NULL,
+     table_state, table_print_state, table_destroy},
+    {"tournament", sizeof(Tournament), tournament_init, tournament_reset, tournament_predict, tournament_update,
+     tournament_print_stats, tournament_clear_stats, tournament_state, tournament_print_state, tournament_destroy},
+    {"TAGE", sizeof(Tage), tage_init, tage_reset, tage_predict, tage_update, tage_print_stats, tage_clear_stats,
+     tage_state, NULL, tage_destroy},
+};
+
+const char *predictor_name(int type)
+{
+    return predictor_ops[type].name;
+}
+
+// type named by the first length characters of text, or its number; -1 if none
+int predictor_parse(const char *text, int length)
+{
+    for (int type = 0; type < PREDICTORS; type++)
+    {
+        if ((int)strlen(predictor_ops[type].name) == length && strncasecmp(text, predictor_ops[type].name, length) == 0)
+        {
+            return type;
+        }
+    }
+    if (length == 1 && text[0] >= '0' && text[0] < '0' + PREDICTORS)
+    {
+        return text[0] - '0';
+    }
+    return -1;
+}
+
+// build the predictor cpu->config selects
+int predictor_alloc(CPU *cpu)
+{
+    const PredictorOps *ops = &predictor_ops[CONFIG(cpu, predictor)];
+    Predictor *p;
+
+    predictor_free(cpu);
+    p = calloc(1, ops->size);
+    if (!p)
+    {
+        return -1;
+    }
+    cpu->predictor = p;
+    p->ops = ops;
+    p->history_bits = CONFIG(cpu, history_bits);
+    if (!p->history_bits)
+    {
+        p->history_bits = CONFIG(cpu, predictor) == PREDICTOR_TAGE ? 64 : index_bits(CONFIG(cpu, pt_size));
+    }
+    p->history_mask = p->history_bits == 64 ? ~0ull : (1ull << p->history_bits) - 1;
+    p->counter_max = (1 << CONFIG(cpu, pt_counter_bits)) - 1;
+    p->counter_taken = 1 << (CONFIG(cpu, pt_counter_bits) - 1);
+    p->btb_assoc = CONFIG(cpu, btb_assoc);
+    p->btb_sets = CONFIG(cpu, btb_size) / p->btb_assoc;
+    p->btb = malloc(sizeof(BTBEntry) * CONFIG(cpu, btb_size));
+    return !p->btb || ops->init(p, &cpu->config) ? -1 : 0;
+}
+
+void predictor_free(CPU *cpu)
+{
+    Predictor *p = cpu->predictor;
+
+    if (!p)
+    {
+        return;
+    }
+    p->ops->destroy(p);
+    free(p->btb);
+    free(p);
+    cpu->predictor = NULL;
+}
+
+// untrained tables, empty BTB and history
+void predictor_reset(CPU *cpu)
+{
+    Predictor *p = cpu->predictor;
+
+    p->ops->reset(p);
+    for (int i = 0; i < p->btb_sets * p->btb_assoc; i++)
+    {
+        p->btb[i].pc = -1;
+        p->btb[i].target = -1;
+    }
+    p->history = p->retired_history = 0;
+    memset(&p->stats, 0, sizeof(p->stats));
+}
+
+// direction of the branch s being fetched, s keeps the history it used
+bool predictor_predict(CPU *cpu, Stage *s)
+{
+    Predictor *p = cpu->predictor;
+
+    s->history = p->history;
+    s->predicted_taken = p->ops->predict(p, s->pc, p->history);
+    p->history = (p->history << 1 | s->predicted_taken) & p->history_mask;
+    return s->predicted_taken;
+}
+
+// branch s commits with outcome taken, returns TRUE when it was mispredicted
+bool predictor_update(CPU *cpu, Stage *s, bool taken)
+{
+    Predictor *p = cpu->predictor;
+
+    p->ops->update(p, s->pc, s->history, taken, s->predicted_taken);
+    p->retired_history = (p->retired_history << 1 | taken) & p->history_mask;
+    if (taken)
+    {
+        p->stats.taken++;
+        btb_update(cpu, s->pc, s->imm / 4);
+    }
+    return taken != s->predicted_taken;
+}
+
+// s went the other way, everything fetched after it is gone: the history
+// is what s saw followed by its real outcome
+void predictor_recover(CPU *cpu, Stage *s, bool taken)
+{
+    Predictor *p = cpu->predictor;
+
+    p->history = (s->history << 1 | taken) & p->history_mask;
+}
+
+// everything in flight squashed, back to the committed history
+void predictor_flush(CPU *cpu)
+{
+    cpu->predictor->history = cpu->predictor->retired_history;
+}
+
+// counters back to zero, what the tables learned stays
+void predictor_clear_stats(CPU *cpu)
+{
+    Predictor *p = cpu->predictor;
+
+    memset(&p->stats, 0, sizeof(p->stats));
+    if (p->ops->clear_stats)
+    {
+        p->ops->clear_stats(p);
+    }
+}
+
+// histories, BTB, counters and the tables of the predictor in use
+void predictor_state(CPU *cpu, StateFile *f)
+{
+    Predictor *p = cpu->predictor;
+
+    STATE(f, p->history);
+    STATE(f, p->retired_history);
+    STATE_ARRAY(f, p->btb, p->btb_sets * p->btb_assoc);
+    STATE(f, p->stats);
+    p->ops->state(p, f);
+}
+
+// target of the branch at pc if the BTB holds it
+bool btb_lookup(CPU *cpu, int pc, int *target)
+{
+    Predictor *p = cpu->predictor;
+    BTBEntry *ways = p->btb + (pc % p->btb_sets) * p->btb_assoc;
+
+    p->stats.btb_lookups++;
+    for (int way = 0; way < p->btb_assoc; way++)
+    {
+        if (ways[way].pc == pc)
+        {
+            BTBEntry hit = ways[way];
+            for (; way > 0; way--)
+            {
+                ways[way] = ways[way - 1];
+            }
+            ways[0] = hit;
+            *target = hit.target;
+            p->stats.btb_hits++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// taken branch at pc goes to target, least recently used way replaced
+void btb_update(CPU *cpu, int pc, int target)
+{
+    Predictor *p = cpu->predictor;
+    BTBEntry *ways = p->btb + (pc % p->btb_sets) * p->btb_assoc;
+    int way;
+
+    for (way = 0; way < p->btb_assoc - 1 && ways[way].pc != pc; way++)
+        ;
+    for (; way > 0; way--)
+    {
+        ways[way] = ways[way - 1];
+    }
+    ways[0].pc = pc;
+    ways[0].target = target;
+}
+
+void predictor_print_stats(CPU *cpu)
+{
+    Predictor *p = cpu->predictor;
+    PredictorStats *s = &p->stats;
+
+    printf("Branch predictor: %s, %d-entry tables of %d-bit counters", p->ops->name, CONFIG(cpu, pt_size),
+           CONFIG(cpu, pt_counter_bits));
+    if (CONFIG(cpu, predictor) != PREDICTOR_BIMODAL)
+    {
+        printf(", %d history bits", p->history_bits);
+    }
+    printf("\n");
+    printf("  branches %d, taken %ld, mispredicted %d, accuracy %.2f%%, MPKI %.2f\n", cpu->branches, s->taken,
+           cpu->mispredicts, cpu->branches ? 100.0 * (cpu->branches - cpu->mispredicts) / cpu->branches : 0.0,
+           cpu->simulation_count ? 1000.0 * cpu->mispredicts / cpu->simulation_count : 0.0);
+    printf("  BTB: %d entries, %d-way, lookups %ld, hits %ld (%.1f%%)\n", CONFIG(cpu, btb_size), p->btb_assoc,
+           s->btb_lookups, s->btb_hits, s->btb_lookups ? 100.0 * s->btb_hits / s->btb_lookups : 0.0);
+    if (p->ops->print_stats)
+    {
+        p->ops->print_stats(p);
+    }
+}
+
+// per-cycle trace dump
+void predictor_print_state(CPU *cpu)
+{
+    Predictor *p = cpu->predictor;
+
+    printf("History: %llx, retired %llx\n", (unsigned long long)p->history, (unsigned long long)p->retired_history);
+    if (p->ops->print_state)
+    {
+        p->ops->print_state(p);
+    }
+    for (int i = 0; i < p->btb_sets * p->btb_assoc; i++)
+    {
+        printf("BTB%d: [pc: %d, target: %d]\n", i, p->btb[i].pc, p->btb[i].target);
+    }
+}
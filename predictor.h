@@ -0,0 +1,96 @@
+/*
+ * Description: Branch prediction. A direction predictor is a table of
+ *              operations over a state that embeds Predictor first, so
+ *              bimodal, gshare, tournament and TAGE plug in behind the same
+ *              predict, update and recover calls. Fetch predicts with the
+ *              speculative global history, commit trains with the history
+ *              the branch saw, and a redirect repairs the history from the
+ *              branch that caused it. The branch target buffer is shared by
+ *              every predictor.
+ */
+
+#ifndef _PREDICTOR_H_
+#define _PREDICTOR_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+typedef struct Predictor Predictor;
+struct StateFile;
+
+typedef struct PredictorOps
+{
+    const char *name;
+    size_t size;                // state allocated, Predictor included
+    int (*init)(Predictor *p, const CPUConfig *config);     // allocate tables
+    void (*reset)(Predictor *p);
+    bool (*predict)(Predictor *p, int pc, uint64_t history);
+    // train with the outcome and the history the prediction used
+    void (*update)(Predictor *p, int pc, uint64_t history, bool taken, bool predicted);
+    void (*print_stats)(const Predictor *p);                // NULL for none
+    void (*clear_stats)(Predictor *p);                      // keep the tables, NULL for no stats
+    void (*state)(Predictor *p, struct StateFile *f);       // tables and counters, for checkpoints
+    void (*print_state)(const Predictor *p);                // tables for the trace, NULL for none
+    void (*destroy)(Predictor *p);
+} PredictorOps;
+
+typedef struct BTBEntry
+{
+    int pc;                     // full instruction index, -1 when empty
+    int target;
+} BTBEntry;
+
+typedef struct PredictorStats
+{
+    long taken;                 // committed branches taken
+    long btb_lookups;           // branches fetched
+    long btb_hits;
+} PredictorStats;
+
+struct Predictor
+{
+    const PredictorOps *ops;
+    uint64_t history;           // speculative, newest outcome in bit 0
+    uint64_t retired_history;   // committed branches only
+    uint64_t history_mask;
+    int history_bits;
+    int counter_max;            // saturating counters of counter_bits
+    int counter_taken;
+    // sets * assoc entries, each set most recently used first
+    BTBEntry *btb;
+    int btb_sets;
+    int btb_assoc;
+    PredictorStats stats;
+};
+
+const char *predictor_name(int type);
+
+int predictor_parse(const char *text, int length);
+
+int predictor_alloc(CPU *cpu);
+
+void predictor_free(CPU *cpu);
+
+void predictor_reset(CPU *cpu);
+
+bool predictor_predict(CPU *cpu, Stage *s);
+
+bool predictor_update(CPU *cpu, Stage *s, bool taken);
+
+void predictor_recover(CPU *cpu, Stage *s, bool taken);
+
+void predictor_flush(CPU *cpu);
+
+void predictor_clear_stats(CPU *cpu);
+
+void predictor_state(CPU *cpu, struct StateFile *f);
+
+bool btb_lookup(CPU *cpu, int pc, int *target);
+
+void btb_update(CPU *cpu, int pc, int target);
+
+void predictor_print_stats(CPU *cpu);
+
+void predictor_print_state(CPU *cpu);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Description: Structure-of-arrays program table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "program.h"
+
+// functional unit an opcode executes on
+int fu_class(int opcode)
+{
+    switch (opcode)
+    {
+    case MUL:
+    case MULL:
+        return FU_MUL;
+    case DIV:
+    case DIVL:
+        return FU_DIV;
+    case LD:
+    case ST:
+    case LDL:
+    case STL:
+        return FU_MEM;
+    case BEZ:
+    case BGEZ:
+    case BLEZ:
+    case BGTZ:
+    case BLTZ:
+        return FU_BRANCH;
+    default:
+        return FU_ADD;
+    }
+}
+
+// allocate a table for size instructions, the text is attached by the loader
+Program *program_create(int size)
+{
+    Program *program = calloc(1, sizeof(Program));
+    if (!program)
+    {
+        return NULL;
+    }
+    program->size = size;
+    program->opcode = malloc(size);
+    program->fu = malloc(size);
+    program->rd = malloc(size);
+    program->rs1 = malloc(size);
+    program->rs2 = malloc(size);
+    program->imm = malloc(sizeof(int32_t) * size);
+    program->text_offset = calloc(size, sizeof(uint32_t));
+    if (!program->opcode || !program->fu || !program->rd || !program->rs1 || !program->rs2 || !program->imm ||
+        !program->text_offset)
+    {
+        program_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+void program_set(Program *program, int pc, const Instruction *inst)
+{
+    program->opcode[pc] = inst->opcode;
+    program->fu[pc] = fu_class(inst->opcode);
+    program->rd[pc] = inst->rd;
+    program->rs1[pc] = inst->rs1;
+    program->rs2[pc] = inst->rs2;
+    program->imm[pc] = inst->op1;
+}
+
+void program_get(const Program *program, int pc, Instruction *inst)
+{
+    inst->instruction_no = pc;
+    inst->opcode = program->opcode[pc];
+    inst->rd = program->rd[pc];
+    inst->rs1 = program->rs1[pc];
+    inst->rs2 = program->rs2[pc];
+    inst->op1 = program->imm[pc];
+}
+
+// source line of instruction pc, "" when the text was not kept
+const char *program_text(const Program *program, int pc)
+{
+    if (!program->text)
+    {
+        return "";
+    }
+    return program->text + program->text_offset[pc];
+}
+
+void program_free(Program *program)
+{
+    if (!program)
+    {
+        return;
+    }
+    free(program->opcode);
+    free(program->fu);
+    free(program->rd);
+    free(program->rs1);
+    free(program->rs2);
+    free(program->imm);
+    free(program->text_offset);
+    free(program->text);
+    free(program);
+}
@@ -0,0 +1,39 @@
+/*
+ * Description: Decoded text programs stored as a structure of arrays. The
+ *              fields fetch reads every cycle live in small dense arrays,
+ *              the display text is kept apart and only read for tracing.
+ */
+
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+#include <stdint.h>
+#include "cpu.h"
+
+typedef struct Program
+{
+    int size;
+    // hot: one array per field, indexed by pc
+    uint8_t *opcode;
+    uint8_t *fu;
+    uint8_t *rd;
+    uint8_t *rs1;
+    uint8_t *rs2;
+    int32_t *imm;
+    // cold: source lines, text + text_offset[pc]
+    char *text;
+    uint32_t *text_offset;
+} Program;
+
+int fu_class(int opcode);
+
+Program *program_create(int size);
+
+void program_set(Program *program, int pc, const Instruction *inst);
+
+void program_get(const Program *program, int pc, Instruction *inst);
+
+const char *program_text(const Program *program, int pc);
+
+void program_free(Program *program);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Description: Register renaming onto a merged physical register file.
+ *
+ * The free list is a ring of physical register numbers. Rename takes from
+ * the front and commit returns the register a destination replaced at the
+ * back, so the registers allocated after a checkpoint sit just in front of
+ * the current position and rewinding the allocation count frees them all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "rename.h"
+
+// size the register file, free list and checkpoints from cpu->config
+int rename_alloc(CPU *cpu)
+{
+    RenameState *rn;
+    int size = CONFIG(cpu, phys_regs) ? CONFIG(cpu, phys_regs) : REG_COUNT + CONFIG(cpu, rob_size);
+
+    rename_free(cpu);
+    if (size <= REG_COUNT)
+    {
+        fprintf(stderr, "Error: [rename] registers must be 0 or more than %d\n", REG_COUNT);
+        return -1;
+    }
+    rn = calloc(1, sizeof(RenameState));
+    if (!rn)
+    {
+        return -1;
+    }
+    cpu->rename = rn;
+    rn->size = size;
+    rn->value = malloc(sizeof(int) * size);
+    rn->ready = malloc(sizeof(bool) * size);
+    rn->free_list = malloc(sizeof(int) * size);
+    rn->checkpoints = malloc(sizeof(Checkpoint) * CONFIG(cpu, checkpoints));
+    if (!rn->value || !rn->ready || !rn->free_list || !rn->checkpoints)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void rename_free(CPU *cpu)
+{
+    RenameState *rn = cpu->rename;
+
+    if (!rn)
+    {
+        return;
+    }
+    free(rn->value);
+    free(rn->ready);
+    free(rn->free_list);
+    free(rn->checkpoints);
+    free(rn);
+    cpu->rename = NULL;
+}
+
+// architectural register i in physical register i, the rest free
+void rename_reset(CPU *cpu)
+{
+    RenameState *rn = cpu->rename;
+
+    for (int i = 0; i < REG_COUNT; i++)
+    {
+        rn->map[i] = rn->committed[i] = i;
+        rn->value[i] = cpu->regs[i].value;
+    }
+    for (int i = 0; i < rn->size; i++)
+    {
+        rn->ready[i] = true;
+    }
+    rn->allocated = 0;
+    rn->free_count = rn->size - REG_COUNT;
+    for (int i = 0; i < rn->free_count; i++)
+    {
+        rn->free_list[i] = REG_COUNT + i;
+    }
+    rn->checkpoint_head = 0;
+    rn->checkpoint_count = 0;
+}
+
+// SLOT_USED if s can be renamed now, else why it waits
+int rename_check(CPU *cpu, Stage *s)
+{
+    RenameState *rn = cpu->rename;
+
+    if (s->dest != NO_UOP && rn->free_count == 0)
+    {
+        rn->stats.free_list_stalls++;
+        return SLOT_PRF;
+    }
+    if (IS_BRANCH(s->opcode) && rn->checkpoint_count == CONFIG(cpu, checkpoints))
+    {
+        rn->stats.checkpoint_stalls++;
+        return SLOT_CHECKPOINT;
+    }
+    return SLOT_USED;
+}
+
+// a source reads its physical register if written back, else waits on it
+static void rename_source(RenameState *rn, int reg, int *value, int *tag, bool *ready)
+{
+    *tag = NO_UOP;
+    *ready = true;
+    if (reg == NO_UOP)
+    {
+        return;     // immediate, decode set the value
+    }
+    int preg = rn->map[reg];
+    if (rn->ready[preg])
+    {
+        *value = rn->value[preg];
+    }
+    else
+    {
+        *tag = preg;
+        *ready = false;
+    }
+}
+
+// map the sources, give the destination a new physical register and
+// checkpoint the map after a branch; rename_check said it fits
+void rename_uop(CPU *cpu, Stage *s)
+{
+    RenameState *rn = cpu->rename;
+
+    // sources first, an instruction may overwrite its own source
+    rename_source(rn, s->src1_reg, &s->src1_value, &s->src1_tag, &s->src1_ready);
+    rename_source(rn, s->src2_reg, &s->src2_value, &s->src2_tag, &s->src2_ready);
+    s->preg = s->old_preg = s->checkpoint = NO_UOP;
+    if (s->dest != NO_UOP)
+    {
+        s->preg = rn->free_list[rn->allocated++ % rn->size];
+        s->old_preg = rn->map[s->dest];
+        rn->free_count--;
+        rn->ready[s->preg] = false;
+        rn->map[s->dest] = s->preg;
+    }
+    if (IS_BRANCH(s->opcode))
+    {
+        int n = CONFIG(cpu, checkpoints);
+        Checkpoint *c;
+
+        s->checkpoint = (rn->checkpoint_head + rn->checkpoint_count++) % n;
+        c = &rn->checkpoints[s->checkpoint];
+        memcpy(c->map, rn->map, sizeof(c->map));
+        c->allocated = rn->allocated;
+    }
+}
+
+// result written back, later renames read it directly
+void rename_write(CPU *cpu, int preg, int value)
+{
+    cpu->rename->value[preg] = value;
+    cpu->rename->ready[preg] = true;
+}
+
+// s leaves the ROB: its register becomes architectural and the one it
+// replaced returns to the free list, a branch drops its checkpoint
+void rename_commit(CPU *cpu, Stage *s)
+{
+    RenameState *rn = cpu->rename;
+
+    if (s->dest != NO_UOP)
+    {
+        rn->committed[s->dest] = s->preg;
+        rn->free_list[(rn->allocated + rn->free_count++) % rn->size] = s->old_preg;
+    }
+    if (s->checkpoint != NO_UOP)
+    {
+        assert(s->checkpoint == rn->checkpoint_head);
+        rn->checkpoint_head = (rn->checkpoint_head + 1) % CONFIG(cpu, checkpoints);
+        rn->checkpoint_count--;
+        s->checkpoint = NO_UOP;
+    }
+}
+
+// mispredicted branch s: restore the map it saved and free every register
+// renamed after it, its checkpoint and all younger ones are dropped
+void rename_recover(CPU *cpu, Stage *s)
+{
+    RenameState *rn = cpu->rename;
+    RenameStats *st = &rn->stats;
+    int n = CONFIG(cpu, checkpoints);
+    Checkpoint *c = &rn->checkpoints[s->checkpoint];
+    long latency = cpu->clockCycle - s->done_cycle;
+
+    memcpy(rn->map, c->map, sizeof(rn->map));
+    rn->free_count += rn->allocated - c->allocated;
+    rn->allocated = c->allocated;
+    rn->checkpoint_count = (s->checkpoint - rn->checkpoint_head + n) % n;
+    s->checkpoint = NO_UOP;
+
+    st->recoveries++;
+    st->recovery_cycles += latency;
+    if (latency > st->recovery_max)
+    {
+        st->recovery_max = latency;
+    }
+}
+
+// everything in flight squashed: back to the committed map; uops take
+// registers in program order and free them in order, so the ones in flight
+// are the last taken from the free list
+void rename_flush(CPU *cpu)
+{
+    RenameState *rn = cpu->rename;
+    int in_flight = rn->size - REG_COUNT - rn->free_count;
+
+    memcpy(rn->map, rn->committed, sizeof(rn->map));
+    rn->allocated -= in_flight;
+    rn->free_count += in_flight;
+    rn->checkpoint_count = 0;
+}
+
+// once per cycle, physical register pressure
+void rename_sample(CPU *cpu)
+{
+    RenameState *rn = cpu->rename;
+    int in_use = rn->size - rn->free_count;
+
+    rn->stats.in_use_cycles += in_use;
+    if (in_use > rn->stats.in_use_max)
+    {
+        rn->stats.in_use_max = in_use;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Description: Register renaming onto a merged physical register file. A
+ *              register alias table maps each architectural register to a
+ *              physical one, destinations take a register from a free list
+ *              and every branch saves a checkpoint of the map, so a
+ *              mispredict restores it in one step.
+ */
+
+#ifndef _RENAME_H_
+#define _RENAME_H_
+#include "cpu.h"
+
+typedef struct RenameStats
+{
+    long free_list_stalls;      // dispatch cycles blocked on an empty free list
+    long checkpoint_stalls;     // dispatch cycles blocked with every checkpoint taken
+    long in_use_cycles;         // physical registers holding a value, summed per cycle
+    int in_use_max;
+    long recoveries;
+    long recovery_cycles;       // from the branch resolving to the restored map, summed
+    long recovery_max;
+} RenameStats;
+
+// the map as the branch saw it and the free list position to rewind to
+typedef struct Checkpoint
+{
+    int map[REG_COUNT];
+    unsigned int allocated;
+} Checkpoint;
+
+typedef struct RenameState
+{
+    int size;                   // physical registers
+    int *value;
+    bool *ready;                // written back, dependents read value directly
+    int map[REG_COUNT];         // speculative RAT, updated at rename
+    int committed[REG_COUNT];   // retirement RAT, updated at commit
+    // free list, a ring of size entries; allocated and freed only grow so
+    // a checkpoint can rewind the allocations made after it
+    int *free_list;
+    unsigned int allocated;
+    int free_count;
+    // one checkpoint per branch in flight, a ring of CONFIG(cpu, checkpoints)
+    Checkpoint *checkpoints;
+    int checkpoint_head;
+    int checkpoint_count;
+    RenameStats stats;
+} RenameState;
+
+int rename_alloc(CPU *cpu);
+
+void rename_free(CPU *cpu);
+
+void rename_reset(CPU *cpu);
+
+int rename_check(CPU *cpu, Stage *s);
+
+void rename_uop(CPU *cpu, Stage *s);
+
+void rename_write(CPU *cpu, int preg, int value);
+
+void rename_commit(CPU *cpu, Stage *s);
+
+void rename_recover(CPU *cpu, Stage *s);
+
+void rename_flush(CPU *cpu);
+
+void rename_sample(CPU *cpu);
+
+#endif
@@ -0,0 +1,439 @@
+/*
+ * Description: Sampled simulation, systematic sampling as in SMARTS.
+ *
+ * Sample k starts at instruction k * period: its checkpoint is taken by the
+ * functional pass with the caches and predictor warmed on everything
+ * before it, the detailed run commits warmup instructions to fill the
+ * pipeline and then measures the next interval. Each sample gives a CPI;
+ * their mean estimates the program's CPI and the spread between samples
+ * gives its confidence interval.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include "cpu.h"
+#include "trace.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "predictor.h"
+#include "sample.h"
+
+#define SAMPLE_PERIOD   1000000
+#define SAMPLE_INTERVAL 10000
+#define SAMPLE_WARMUP   2000
+#define SAMPLE_Z        1.96    // 95% confidence, normal approximation
+
+typedef struct SampleResult
+{
+    long start;                 // instructions before the checkpoint
+    int status;
+    bool complete;              // measured a whole interval before the program ended
+    long cycles;                // measured interval only
+    long instructions;
+} SampleResult;
+
+typedef struct Sampler
+{
+    SharedProgram program;
+    char *program_file;
+    CPUConfig config;
+    char *memory_file;
+    long period;
+    long interval;
+    long warmup;
+    int warm;                   // functional warming between samples
+    char *dir;                  // checkpoints
+    int own_dir;                // made here, removed when done
+    SampleResult *samples;
+    int sample_count;
+    long instructions;          // run by the functional pass
+    atomic_int next;
+} Sampler;
+
+static struct option sample_options[] = {
+    {"period", required_argument, NULL, 'p'},
+    {"interval", required_argument, NULL, 'i'},
+    {"warmup", required_argument, NULL, 'w'},
+    {"cold", no_argument, NULL, 'c'},
+    {"checkpoint-dir", required_argument, NULL, 'd'},
+    {"config", required_argument, NULL, 'C'},
+    {"predictor", required_argument, NULL, 'D'},
+    {"memory", required_argument, NULL, 'm'},
+    {"threads", required_argument, NULL, 'j'},
+    {"verbose", no_argument, NULL, 'v'},
+    {NULL, 0, NULL, 0}};
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Newton's method, the simulator does not link libm
+static double square_root(double x)
+{
+    double r = x > 1 ? x : 1;
+
+    if (x <= 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        double next = (r + x / r) / 2;
+        if (next >= r)
+        {
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
+static void checkpoint_path(const Sampler *s, int sample, char *path, size_t size)
+{
+    snprintf(path, size, "%s/sample-%06d.ckpt", s->dir, sample);
+}
+
+static CPU *sample_cpu(Sampler *s)
+{
+    CPU *cpu = CPU_init();
+
+    if (!cpu)
+    {
+        return NULL;
+    }
+    cpu->config = s->config;
+    cpu->memory_file = s->memory_file;
+    cpu->trace->level = TRACE_OFF;
+    shared_program_attach(cpu, &s->program);
+    return cpu;
+}
+
+// run the whole program functionally, a checkpoint at the start of every
+// period; the last period may be cut short by the end of the program
+static int functional_pass(Sampler *s)
+{
+    CPU *cpu = sample_cpu(s);
+    int capacity = 64;
+    int status = 0;
+
+    s->samples = malloc(sizeof(SampleResult) * capacity);
+    if (!cpu || !s->samples)
+    {
+        return -1;
+    }
+    cpu->warm = s->warm;
+    if (CPU_setup(cpu, s->program_file))
+    {
+        CPU_stop(cpu);
+        return -1;
+    }
+    for (;;)
+    {
+        char path[4096];
+        if (s->sample_count == capacity)
+        {
+            SampleResult *grown = realloc(s->samples, sizeof(SampleResult) * capacity * 2);
+            if (!grown)
+            {
+                status = -1;
+                break;
+            }
+            s->samples = grown;
+            capacity *= 2;
+        }
+        checkpoint_path(s, s->sample_count, path, sizeof(path));
+        if (checkpoint_save(cpu, path))
+        {
+            status = -1;
+            break;
+        }
+        s->samples[s->sample_count++] = (SampleResult){cpu->fast_forwarded, -1, false, 0, 0};
+        if (CPU_fast_forward(cpu, s->period) < s->period)
+        {
+            break;
+        }
+    }
+    s->instructions = cpu->fast_forwarded;
+    CPU_stop(cpu);
+    return status;
+}
+
+static void *sample_worker(void *arg)
+{
+    Sampler *s = arg;
+    int id;
+
+    while ((id = atomic_fetch_add(&s->next, 1)) < s->sample_count)
+    {
+        SampleResult *r = &s->samples[id];
+        char path[4096];
+        CPU *cpu = sample_cpu(s);
+
+        if (!cpu)
+        {
+            continue;
+        }
+        checkpoint_path(s, id, path, sizeof(path));
+        cpu->restore_file = path;
+        cpu->measure_from = s->warmup;
+        cpu->max_instructions = s->warmup + s->interval;
+        r->status = CPU_run(cpu, s->program_file);
+        if (cpu->measure_cycle >= 0)
+        {
+            // commit groups straddle both ends, give or take a few instructions
+            r->cycles = cpu->clockCycle - cpu->measure_cycle;
+            r->instructions = cpu->simulation_count - cpu->measure_count;
+        }
+        r->complete = r->status == 0 && cpu->simulation_count >= cpu->max_instructions && r->instructions > 0;
+        CPU_stop(cpu);
+        if (s->own_dir)
+        {
+            unlink(path);
+        }
+    }
+    return NULL;
+}
+
+static int run_samples(Sampler *s, int threads)
+{
+    pthread_t *workers;
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > s->sample_count)
+    {
+        threads = s->sample_count;
+    }
+    workers = malloc(sizeof(pthread_t) * (threads > 0 ? threads : 1));
+    if (!workers)
+    {
+        // run them here instead
+        sample_worker(s);
+        return 1;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, sample_worker, s);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return threads;
+}
+
+// mean CPI of the complete samples, its confidence interval turned into IPC
+static void print_estimate(const Sampler *s, int verbose)
+{
+    double sum = 0;
+    double squares = 0;
+    int n = 0;
+
+    if (verbose)
+    {
+        printf("%-7s %12s %10s %12s %9s  %s\n", "sample", "start", "cycles", "instructions", "IPC", "status");
+    }
+    for (int i = 0; i < s->sample_count; i++)
+    {
+        const SampleResult *r = &s->samples[i];
+        if (verbose)
+        {
+            printf("%-7d %12ld %10ld %12ld %9.4f  %s\n", i, r->start, r->cycles, r->instructions,
+                   r->cycles ? (double)r->instructions / r->cycles : 0.0,
+                   r->complete ? "ok" : r->status ? "failed" : "ended early");
+        }
+        if (r->complete)
+        {
+            double cpi = (double)r->cycles / r->instructions;
+            sum += cpi;
+            squares += cpi * cpi;
+            n++;
+        }
+    }
+    if (n == 0)
+    {
+        printf("No complete sample, the program is shorter than the warmup and interval\n");
+        return;
+    }
+
+    double mean = sum / n;
+    double variance = n > 1 ? (squares - sum * mean) / (n - 1) : 0;
+    double deviation = square_root(variance > 0 ? variance : 0);
+    double half = SAMPLE_Z * deviation / square_root(n);
+    double cv = deviation / mean;
+
+    printf("IPC: %f", 1 / mean);
+    if (n > 1)
+    {
+        printf(" (95%% confidence %f to ", 1 / (mean + half));
+        if (mean > half)
+        {
+            printf("%f", 1 / (mean - half));
+        }
+        else
+        {
+            printf("unbounded");
+        }
+        printf(", +-%.2f%%)", 100 * half / mean);
+    }
+    printf(" from %d of %d samples\n", n, s->sample_count);
+    printf("Estimated cycles: %.0f for %ld instructions\n", mean * s->instructions, s->instructions);
+    if (n > 1)
+    {
+        // SMARTS sizing: +-3% at 99.7% confidence needs (3 * cv / 0.03)^2 samples, rounded up
+        double needed = (100 * cv) * (100 * cv);
+        long samples = (long)needed < needed ? (long)needed + 1 : (long)needed;
+        printf("  CPI coefficient of variation %.3f, +-3%% at 99.7%% confidence needs about %ld sample%s\n", cv,
+               samples > 1 ? samples : 1, samples > 1 ? "s" : "");
+    }
+}
+
+static void free_sampler(Sampler *s)
+{
+    if (s->own_dir && s->dir)
+    {
+        // samples that never ran leave their checkpoint behind
+        for (int i = 0; i < s->sample_count; i++)
+        {
+            char path[4096];
+            checkpoint_path(s, i, path, sizeof(path));
+            unlink(path);
+        }
+        rmdir(s->dir);
+    }
+    shared_program_close(&s->program);
+    free(s->samples);
+}
+
+int run_sample(int argc, char **argv)
+{
+    Sampler s;
+    char dir[] = "/tmp/sim-samples-XXXXXX";
+    struct timespec start;
+    int threads = 0;
+    int verbose = FALSE;
+    int status = 0;
+    int opt;
+
+    memset(&s, 0, sizeof(s));
+    s.memory_file = "memory_map.txt";
+    s.period = SAMPLE_PERIOD;
+    s.interval = SAMPLE_INTERVAL;
+    s.warmup = SAMPLE_WARMUP;
+    s.warm = TRUE;
+    config_defaults(&s.config);
+    atomic_init(&s.next, 0);
+
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, "m:j:v", sample_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            s.period = atol(optarg);
+            break;
+        case 'i':
+            s.interval = atol(optarg);
+            break;
+        case 'w':
+            s.warmup = atol(optarg);
+            break;
+        case 'c':
+            s.warm = FALSE;
+            break;
+        case 'd':
+            s.dir = optarg;
+            break;
+        case 'C':
+            if (config_load(&s.config, optarg))
+            {
+                return -1;
+            }
+            break;
+        case 'D':
+            s.config.predictor = predictor_parse(optarg, (int)strlen(optarg));
+            if (s.config.predictor < 0)
+            {
+                fprintf(stderr, "Error: unknown predictor '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'm':
+            s.memory_file = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'v':
+            verbose = TRUE;
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Error : missing program file\n");
+        return -1;
+    }
+    if (s.interval < 1 || s.warmup < 0 || s.period < s.warmup + s.interval)
+    {
+        fprintf(stderr, "Error: the period must hold the warmup and the interval\n");
+        return -1;
+    }
+    if (config_check(&s.config))
+    {
+        return -1;
+    }
+    s.program_file = argv[optind];
+    if (shared_program_open(s.program_file, &s.program))
+    {
+        fprintf(stderr, "Error opening program file: %s\n", s.program_file);
+        return -1;
+    }
+    if (!s.dir)
+    {
+        s.dir = mkdtemp(dir);
+        s.own_dir = TRUE;
+        if (!s.dir)
+        {
+            fprintf(stderr, "Error: cannot create a checkpoint directory\n");
+            free_sampler(&s);
+            return -1;
+        }
+    }
+
+    printf("Sampling %s: every %ld instructions, %ld warmup and %ld measured, functional warming %s\n",
+           s.program_file, s.period, s.warmup, s.interval, s.warm ? "on" : "off");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (functional_pass(&s))
+    {
+        free_sampler(&s);
+        return 1;
+    }
+    printf("Functional pass: %ld instructions, %d checkpoints in %s, %.1f ms\n", s.instructions, s.sample_count,
+           s.dir, elapsed_ms(&start));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    threads = run_samples(&s, threads);
+    printf("Detailed samples: %d on %d threads, %.1f ms\n", s.sample_count, threads, elapsed_ms(&start));
+    print_estimate(&s, verbose);
+    for (int i = 0; i < s.sample_count; i++)
+    {
+        status |= s.samples[i].status > 0;
+    }
+    free_sampler(&s);
+    return status;
+}
@@ -0,0 +1,14 @@
+/*
+ * Description: Sampled simulation. One functional pass over the program
+ *              drops a checkpoint every period instructions, then a pool of
+ *              threads runs a short detailed warmup and a measured interval
+ *              from each checkpoint, and the intervals are combined into a
+ *              whole-program IPC with a confidence interval.
+ */
+
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+
+int run_sample(int argc, char **argv);
+
+#endif
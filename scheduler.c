@@ -0,0 +1,231 @@
+/*
+ * Description: Reservation stations with bitmask wakeup and select.
+ *
+ * Every set of entries is a bitvector of rs.words 64-bit words:
+ *
+ *   valid           entries holding a uop
+ *   ready[fu]       sources ready, can issue to a unit of class fu
+ *   older[i]        age matrix row, the entries that were already valid
+ *                   when entry i was filled
+ *   waiting[preg]   entries with a source in physical register preg
+ *
+ * Wakeup walks one waiting row, select walks the ready bits of one class
+ * and stops at the first entry with no older ready entry, so the cost per
+ * cycle follows the entries involved rather than the RS size squared.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "scheduler.h"
+#include "rename.h"
+
+#define BIT_WORD(i) ((i) >> 6)
+#define BIT_MASK(i) (1ull << ((i) & 63))
+
+// row of a bitvector matrix
+#define ROW(matrix, row, words) ((matrix) + (size_t)(row) * (words))
+
+// visit each set bit of a bitvector, lowest first
+#define FOR_EACH_BIT(id, vector, words)                                  \
+    for (int w_ = 0; w_ < (words); w_++)                                 \
+        for (uint64_t m_ = (vector)[w_]; m_ && ((id) = w_ * 64 + __builtin_ctzll(m_), 1); m_ &= m_ - 1)
+
+// allocate the bitvectors for CONFIG(cpu, rs_size) entries
+int RS_Alloc(CPU *cpu)
+{
+    ReservationStation *rs = &cpu->rs;
+    int size = CONFIG(cpu, rs_size);
+    int words = (size + 63) / 64;
+
+    RS_Free(cpu);
+    rs->words = words;
+    rs->entries = malloc(sizeof(int) * size);
+    rs->valid = malloc(sizeof(uint64_t) * words);
+    rs->ready = malloc(sizeof(uint64_t) * words * FU_CLASSES);
+    rs->older = malloc(sizeof(uint64_t) * words * size);
+    rs->waiting = malloc(sizeof(uint64_t) * words * cpu->rename->size);
+    if (!rs->entries || !rs->valid || !rs->ready || !rs->older || !rs->waiting)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void RS_Free(CPU *cpu)
+{
+    ReservationStation *rs = &cpu->rs;
+
+    free(rs->entries);
+    free(rs->valid);
+    free(rs->ready);
+    free(rs->older);
+    free(rs->waiting);
+    memset(rs, 0, sizeof(*rs));
+}
+
+void RS_Init(CPU *cpu) {
+    ReservationStation *rs = &cpu->rs;
+    int words = rs->words;
+
+    rs->count = 0;
+    for (int i = 0; i < CONFIG(cpu, rs_size); i++) {
+        rs->entries[i] = NO_UOP;
+    }
+    memset(rs->valid, 0, sizeof(uint64_t) * words);
+    memset(rs->ready, 0, sizeof(uint64_t) * words * FU_CLASSES);
+    memset(rs->waiting, 0, sizeof(uint64_t) * words * cpu->rename->size);
+}
+
+bool RS_IsFull(CPU *cpu) {
+    return cpu->rs.count == CONFIG(cpu, rs_size);
+}
+
+bool RS_IsEmpty(CPU *cpu) {
+    return cpu->rs.count == 0;
+}
+
+// both sources are ready; loads go too, the load queue catches a load
+// that passed an older store to the same address
+static void RS_MakeReady(CPU *cpu, int id)
+{
+    ReservationStation *rs = &cpu->rs;
+    Stage *s = &cpu->uops[rs->entries[id]];
+
+    ROW(rs->ready, s->fu, rs->words)[BIT_WORD(id)] |= BIT_MASK(id);
+}
+
+// add renamed uop to a free reservation station, readiness was set by rename
+int RS_Enqueue(CPU *cpu, int uop) {
+    ReservationStation *rs = &cpu->rs;
+    Stage *s = &cpu->uops[uop];
+    int size = CONFIG(cpu, rs_size);
+    int words = rs->words;
+    int id = -1;
+    int x;
+
+    for (int w = 0; w < words; w++) {
+        uint64_t free = ~rs->valid[w];
+        if (w == words - 1 && (size & 63)) {
+            free &= BIT_MASK(size) - 1;
+        }
+        if (free) {
+            id = w * 64 + __builtin_ctzll(free);
+            break;
+        }
+    }
+    if (id < 0) {
+        return -1;  // RS is full
+    }
+
+    // everything valid is older than the new entry; a stale bit for this
+    // slot left by its previous occupant must not make it look older
+    uint64_t *row = ROW(rs->older, id, words);
+    memcpy(row, rs->valid, sizeof(uint64_t) * words);
+    FOR_EACH_BIT(x, row, words) {
+        ROW(rs->older, x, words)[BIT_WORD(id)] &= ~BIT_MASK(id);
+    }
+
+    rs->valid[BIT_WORD(id)] |= BIT_MASK(id);
+    rs->entries[id] = uop;
+    rs->count++;
+    s->valid = true;
+    s->rs = id;
+    if (!s->src1_ready) {
+        ROW(rs->waiting, s->src1_tag, words)[BIT_WORD(id)] |= BIT_MASK(id);
+    }
+    if (!s->src2_ready) {
+        ROW(rs->waiting, s->src2_tag, words)[BIT_WORD(id)] |= BIT_MASK(id);
+    }
+    if (s->src1_ready && s->src2_ready) {
+        RS_MakeReady(cpu, id);
+    }
+    return id;
+}
+
+// tag broadcast: physical register preg reaches the entries waiting on it
+void RS_Wakeup(CPU *cpu, int preg, int result)
+{
+    ReservationStation *rs = &cpu->rs;
+    uint64_t *row = ROW(rs->waiting, preg, rs->words);
+    int id;
+
+    FOR_EACH_BIT(id, row, rs->words)
+    {
+        Stage *s = &cpu->uops[rs->entries[id]];
+        if (!s->src1_ready && s->src1_tag == preg)
+        {
+            s->src1_value = result;
+            s->src1_ready = true;
+        }
+        if (!s->src2_ready && s->src2_tag == preg)
+        {
+            s->src2_value = result;
+            s->src2_ready = true;
+        }
+        if (s->src1_ready && s->src2_ready)
+        {
+            RS_MakeReady(cpu, id);
+        }
+    }
+    memset(row, 0, sizeof(uint64_t) * rs->words);
+}
+
+// oldest ready entry of class fu, -1 if none
+int RS_Select(CPU *cpu, int fu)
+{
+    ReservationStation *rs = &cpu->rs;
+    uint64_t *ready = ROW(rs->ready, fu, rs->words);
+    int id;
+
+    FOR_EACH_BIT(id, ready, rs->words)
+    {
+        uint64_t *row = ROW(rs->older, id, rs->words);
+        int w;
+        for (w = 0; w < rs->words && !(row[w] & ready[w]); w++)
+            ;
+        if (w == rs->words)
+        {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// drop the entries younger than age, the position in flight of a
+// mispredicted branch, along with the tags they wait on
+void RS_Squash(CPU *cpu, unsigned int age)
+{
+    ReservationStation *rs = &cpu->rs;
+    int id;
+
+    FOR_EACH_BIT(id, rs->valid, rs->words)
+    {
+        Stage *s = &cpu->uops[rs->entries[id]];
+        if (s->seq - cpu->uop_head <= age)
+        {
+            continue;
+        }
+        if (!s->src1_ready)
+        {
+            ROW(rs->waiting, s->src1_tag, rs->words)[BIT_WORD(id)] &= ~BIT_MASK(id);
+        }
+        if (!s->src2_ready)
+        {
+            ROW(rs->waiting, s->src2_tag, rs->words)[BIT_WORD(id)] &= ~BIT_MASK(id);
+        }
+        RS_Clear(cpu, id);
+    }
+}
+
+// free an issued entry
+void RS_Clear(CPU *cpu, int RSEntryId) {
+    ReservationStation *rs = &cpu->rs;
+    Stage *s = &cpu->uops[rs->entries[RSEntryId]];
+
+    rs->valid[BIT_WORD(RSEntryId)] &= ~BIT_MASK(RSEntryId);
+    ROW(rs->ready, s->fu, rs->words)[BIT_WORD(RSEntryId)] &= ~BIT_MASK(RSEntryId);
+    rs->entries[RSEntryId] = NO_UOP;
+    rs->count--;
+    s->valid = false;
+}
@@ -0,0 +1,33 @@
+/*
+ * Description: Reservation stations with bitmask wakeup and select. An
+ *              entry's readiness is one bit, a result wakes only the
+ *              entries recorded as waiting on its physical register, and
+ *              select finds the oldest ready entry of a class through an
+ *              age matrix.
+ */
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+#include "cpu.h"
+
+int RS_Alloc(CPU *cpu);
+
+void RS_Free(CPU *cpu);
+
+void RS_Init(CPU *cpu);
+
+bool RS_IsFull(CPU *cpu);
+
+bool RS_IsEmpty(CPU *cpu);
+
+int RS_Enqueue(CPU *cpu, int uop);
+
+void RS_Wakeup(CPU *cpu, int preg, int result);
+
+int RS_Select(CPU *cpu, int fu);
+
+void RS_Squash(CPU *cpu, unsigned int age);
+
+void RS_Clear(CPU *cpu, int RSEntryId);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * Description: Streaming instruction window. The reader thread keeps the
+ *              window filled ahead of the fetch PC; fetch reads it without
+ *              taking a lock and only blocks when it leaves the window, e.g.
+ *              on a far branch, in which case the reader is redirected.
+ *              Blocking is in host time only, so simulated timing does not
+ *              depend on how fast the reader is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "parser.h"
+#include "image.h"
+#include "stream.h"
+
+static int is_blank_line(const char *line)
+{
+    while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n')
+    {
+        line++;
+    }
+    return *line == '\0';
+}
+
+// remember where text instruction pc starts, once per stride
+static void stream_add_seek_point(ProgramStream *stream, int pc, long offset, int line_no)
+{
+    SeekPoint *points = stream->index;
+
+    if (pc % STREAM_INDEX_STRIDE || pc / STREAM_INDEX_STRIDE != stream->index_count)
+    {
+        return;
+    }
+    if (stream->index_count == stream->index_capacity)
+    {
+        stream->index_capacity = stream->index_capacity ? stream->index_capacity * 2 : 64;
+        points = realloc(points, sizeof(SeekPoint) * stream->index_capacity);
+        if (!points)
+        {
+            // later seeks start from an earlier point instead
+            stream->index_capacity = stream->index_count;
+            return;
+        }
+        stream->index = points;
+    }
+    points[stream->index_count].offset = offset;
+    points[stream->index_count].line_no = line_no;
+    stream->index_count++;
+}
+
+// next non-blank text line for instruction read_pc, NULL at EOF
+static char *stream_next_line(ProgramStream *stream, char **line, size_t *len)
+{
+    ssize_t nread;
+
+    while ((nread = getline(line, len, stream->fp)) != -1)
+    {
+        long offset = stream->read_offset;
+        stream->read_offset += nread;
+        stream->line_no++;
+        if (is_blank_line(*line))
+        {
+            continue;
+        }
+        if ((*line)[nread - 1] == '\n')
+        {
+            (*line)[nread - 1] = '\0';
+        }
+        stream_add_seek_point(stream, stream->read_pc, offset, stream->line_no);
+        return *line;
+    }
+    return NULL;
+}
+
+// move the reader to pc, returns -1 when pc is past the end of the program
+static int stream_seek(ProgramStream *stream, int pc, char **line, size_t *len)
+{
+    SeekPoint *points = stream->index;
+    int point;
+
+    if (stream->is_image)
+    {
+        stream->read_pc = pc;
+        return pc < stream->code_count ? 0 : -1;
+    }
+
+    // restart from the closest seek point unless already on the way to pc
+    point = pc / STREAM_INDEX_STRIDE;
+    if (point >= stream->index_count)
+    {
+        point = stream->index_count - 1;
+    }
+    if (stream->read_pc > pc || stream->read_pc < point * STREAM_INDEX_STRIDE)
+    {
+        fseek(stream->fp, points[point].offset, SEEK_SET);
+        stream->read_offset = points[point].offset;
+        stream->line_no = points[point].line_no - 1;
+        stream->read_pc = point * STREAM_INDEX_STRIDE;
+    }
+
+    while (stream->read_pc < pc)
+    {
+        if (!stream_next_line(stream, line, len))
+        {
+            atomic_store(&stream->eof_pc, stream->read_pc);
+            return -1;
+        }
+        stream->read_pc++;
+    }
+    return 0;
+}
+
+// stop the program before read_pc, fetch gets STREAM_ERROR from there on
+static void stream_fail(ProgramStream *stream)
+{
+    atomic_store(&stream->error, TRUE);
+    atomic_store(&stream->eof_pc, stream->read_pc);
+}
+
+// decode up to count instructions starting at read_pc into the window
+static int stream_decode(ProgramStream *stream, int count, char **line, size_t *len)
+{
+    ParseError err;
+    uint32_t words[STREAM_BATCH];
+    const char *why;
+    int decoded = 0;
+
+    if (stream->is_image)
+    {
+        if (count > stream->code_count - stream->read_pc)
+        {
+            count = stream->code_count - stream->read_pc;
+        }
+        if (count > 0 && pread(stream->fd, words, count * 4, stream->code_offset + (long)stream->read_pc * 4) != count * 4)
+        {
+            fprintf(stderr, "%s: error: short read from program image\n", stream->filename);
+            stream_fail(stream);
+            return 0;
+        }
+        for (decoded = 0; decoded < count; decoded++)
+        {
+            int pc = stream->read_pc;
+            if (check_word(words[decoded], &why))
+            {
+                fprintf(stderr, "%s: error: word %d: %s\n", stream->filename, pc, why);
+                stream_fail(stream);
+                return decoded;
+            }
+            decode_word(words[decoded], pc, &stream->window[pc % stream->capacity]);
+            stream->read_pc++;
+        }
+        return decoded;
+    }
+
+    while (decoded < count && stream_next_line(stream, line, len))
+    {
+        int pc = stream->read_pc;
+        if (parse_instructions(&stream->window[pc % stream->capacity], *line, pc, &err))
+        {
+            err.line = stream->line_no;
+            report_parse_error(stream->filename, *line, &err);
+            stream_fail(stream);
+            return decoded;
+        }
+        stream->read_pc++;
+        decoded++;
+    }
+    if (decoded < count)
+    {
+        atomic_store(&stream->eof_pc, stream->read_pc);
+    }
+    return decoded;
+}
+
+static void *stream_reader(void *arg)
+{
+    ProgramStream *stream = arg;
+    char *line = NULL;
+    size_t len = 0;
+    int at_end = FALSE;
+
+    pthread_mutex_lock(&stream->lock);
+    while (!stream->stop)
+    {
+        if (stream->request_pc >= 0)
+        {
+            // the consumer is blocked in stream_fetch until this is served
+            int pc = stream->request_pc;
+            stream->request_pc = -1;
+            pthread_mutex_unlock(&stream->lock);
+            at_end = stream_seek(stream, pc, &line, &len) < 0;
+            atomic_store(&stream->lo, pc);
+            atomic_store(&stream->hi, pc);
+            pthread_mutex_lock(&stream->lock);
+            pthread_cond_broadcast(&stream->more);
+            continue;
+        }
+
+        int hi = atomic_load(&stream->hi);
+        int room = stream->capacity - (hi - atomic_load(&stream->keep_from));
+        if (at_end)
+        {
+            pthread_cond_wait(&stream->space, &stream->lock);
+            continue;
+        }
+        if (room <= 0)
+        {
+            atomic_store(&stream->reader_waiting, TRUE);
+            pthread_cond_wait(&stream->space, &stream->lock);
+            atomic_store(&stream->reader_waiting, FALSE);
+            continue;
+        }
+        pthread_mutex_unlock(&stream->lock);
+
+        int count = room < STREAM_BATCH ? room : STREAM_BATCH;
+
+        // retire the slots about to be reused before touching them
+        if (hi + count - stream->capacity > atomic_load(&stream->lo))
+        {
+            atomic_store(&stream->lo, hi + count - stream->capacity);
+        }
+        atomic_thread_fence(memory_order_seq_cst);
+
+        int decoded = stream_decode(stream, count, &line, &len);
+        at_end = decoded < count;
+        atomic_store_explicit(&stream->hi, hi + decoded, memory_order_release);
+
+        pthread_mutex_lock(&stream->lock);
+        pthread_cond_broadcast(&stream->more);
+    }
+    pthread_mutex_unlock(&stream->lock);
+
+    free(line);
+    return NULL;
+}
+
+// release what stream_open set up before the reader thread started
+static void stream_free(ProgramStream *stream)
+{
+    if (stream->fp)
+    {
+        fclose(stream->fp);
+    }
+    if (stream->fd >= 0)
+    {
+        close(stream->fd);
+    }
+    free(stream->index);
+    free(stream->window);
+    free(stream);
+}
+
+// NULL after reporting why the program cannot be streamed
+ProgramStream *stream_open(char *filename, int capacity)
+{
+    ProgramStream *stream = calloc(1, sizeof(*stream));
+
+    if (!stream)
+    {
+        return NULL;
+    }
+    if (capacity < 2 * STREAM_BATCH)
+    {
+        capacity = 2 * STREAM_BATCH;
+    }
+
+    stream->filename = filename;
+    stream->fd = -1;
+    stream->capacity = capacity;
+    stream->trail = capacity / 4;
+    stream->request_pc = -1;
+    atomic_init(&stream->lo, 0);
+    atomic_init(&stream->hi, 0);
+    atomic_init(&stream->keep_from, 0);
+    atomic_init(&stream->eof_pc, -1);
+    atomic_init(&stream->reader_waiting, FALSE);
+    atomic_init(&stream->error, FALSE);
+
+    stream->window = malloc(sizeof(Instruction) * capacity);
+    if (!stream->window)
+    {
+        free(stream);
+        return NULL;
+    }
+
+    if (is_program_image(filename))
+    {
+        ImageHeader header;
+
+        stream->is_image = TRUE;
+        stream->fd = open(filename, O_RDONLY);
+        if (stream->fd < 0 || pread(stream->fd, &header, sizeof(header), 0) != sizeof(header) ||
+            header.version != IMAGE_VERSION || header.byte_order != IMAGE_BYTE_ORDER || header.code_count == 0)
+        {
+            fprintf(stderr, "%s: error: not a version %d program image\n", filename, IMAGE_VERSION);
+            stream_free(stream);
+            return NULL;
+        }
+        stream->code_offset = header.code_offset;
+        stream->code_count = header.code_count;
+        atomic_store(&stream->eof_pc, stream->code_count);
+    }
+    else
+    {
+        stream->fp = fopen(filename, "r");
+        if (!stream->fp)
+        {
+            fprintf(stderr, "Error opening program file: %s\n", filename);
+            stream_free(stream);
+            return NULL;
+        }
+        stream_add_seek_point(stream, 0, 0, 1);
+        if (stream->index_count == 0)
+        {
+            stream_free(stream);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->more, NULL);
+    pthread_cond_init(&stream->space, NULL);
+    if (pthread_create(&stream->reader, NULL, stream_reader, stream))
+    {
+        fprintf(stderr, "Error starting program reader thread\n");
+        pthread_mutex_destroy(&stream->lock);
+        pthread_cond_destroy(&stream->more);
+        pthread_cond_destroy(&stream->space);
+        stream_free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+// copy instruction pc into inst, returns -1 past the end of the program and
+// STREAM_ERROR when the reader stopped on a bad instruction at or before pc
+int stream_fetch(ProgramStream *stream, int pc, Instruction *inst)
+{
+    for (;;)
+    {
+        int hi = atomic_load_explicit(&stream->hi, memory_order_acquire);
+        int lo = atomic_load(&stream->lo);
+
+        if (pc >= lo && pc < hi)
+        {
+            *inst = stream->window[pc % stream->capacity];
+            atomic_thread_fence(memory_order_acquire);
+
+            // the reader may have reused the slot while it was copied
+            if (pc >= atomic_load(&stream->lo))
+            {
+                atomic_store_explicit(&stream->keep_from, pc > stream->trail ? pc - stream->trail : 0, memory_order_relaxed);
+                if (atomic_load_explicit(&stream->reader_waiting, memory_order_relaxed) && hi - pc < stream->capacity / 2)
+                {
+                    pthread_mutex_lock(&stream->lock);
+                    pthread_cond_broadcast(&stream->space);
+                    pthread_mutex_unlock(&stream->lock);
+                }
+                return 0;
+            }
+        }
+
+        int eof_pc = atomic_load(&stream->eof_pc);
+        if (eof_pc >= 0 && pc >= eof_pc)
+        {
+            return atomic_load(&stream->error) ? STREAM_ERROR : -1;
+        }
+
+        // outside the window: let the reader catch up, or redirect it when pc is far away
+        pthread_mutex_lock(&stream->lock);
+        atomic_store(&stream->keep_from, pc > stream->trail ? pc - stream->trail : 0);
+        lo = atomic_load(&stream->lo);
+        hi = atomic_load(&stream->hi);
+        if (pc < lo || pc >= hi + stream->capacity / 2)
+        {
+            stream->request_pc = pc;
+        }
+        pthread_cond_broadcast(&stream->space);
+        while (!(pc >= atomic_load(&stream->lo) && pc < atomic_load(&stream->hi)) &&
+               !(atomic_load(&stream->eof_pc) >= 0 && pc >= atomic_load(&stream->eof_pc)))
+        {
+            pthread_cond_wait(&stream->more, &stream->lock);
+        }
+        pthread_mutex_unlock(&stream->lock);
+    }
+}
+
+void stream_close(ProgramStream *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = TRUE;
+    pthread_cond_broadcast(&stream->space);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->more);
+    pthread_cond_destroy(&stream->space);
+    stream_free(stream);
+}
@@ -0,0 +1,71 @@
+/*
+ * Description: Streaming instruction window. A background reader thread
+ *              decodes a text program or an image into a bounded ring
+ *              around the fetch PC, so resident memory does not grow with
+ *              the length of the program.
+ */
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "cpu.h"
+
+// every STREAM_INDEX_STRIDE-th instruction of a text program gets a seek point
+#define STREAM_INDEX_STRIDE 4096
+
+#define STREAM_BATCH 256
+
+// stream_fetch result once the reader failed to read or decode an instruction
+#define STREAM_ERROR -2
+
+typedef struct SeekPoint
+{
+    long offset;
+    int line_no;
+} SeekPoint;
+
+typedef struct ProgramStream
+{
+    char *filename;
+    int is_image;
+    FILE *fp;                   // text source
+    int fd;                     // image source
+    long code_offset;           // byte offset of the image code section
+    int code_count;             // image size, text size is only known at EOF
+
+    Instruction *window;        // instruction pc lives in window[pc % capacity]
+    int capacity;
+    int trail;                  // instructions kept behind the fetch PC
+
+    atomic_int lo;              // window holds [lo, hi)
+    atomic_int hi;
+    atomic_int keep_from;       // lowest pc the consumer still wants
+    atomic_int eof_pc;          // program size once known, -1 before
+    atomic_int reader_waiting;
+    atomic_int error;           // the reader stopped at eof_pc on a bad instruction
+
+    // reader position
+    int read_pc;
+    long read_offset;
+    int line_no;
+    SeekPoint *index;           // text seek points
+    int index_count;
+    int index_capacity;
+
+    int request_pc;             // redirect, -1 when none
+    int stop;
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t more;        // reader published instructions
+    pthread_cond_t space;       // consumer moved or asked for a redirect
+} ProgramStream;
+
+ProgramStream *stream_open(char *filename, int capacity);
+
+int stream_fetch(ProgramStream *stream, int pc, Instruction *inst);
+
+void stream_close(ProgramStream *stream);
+
+#endif
@@ -0,0 +1,566 @@
+/*
+ * Description: Design-space sweeps. The points of a sweep are split into
+ *              one contiguous range per worker thread; a worker that runs
+ *              out steals the upper half of another worker's range. Each
+ *              program is decoded once and shared read-only by all points.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "trace.h"
+#include "batch.h"
+#include "sweep.h"
+#include "predictor.h"
+
+// swept parameters, the predictor varies fastest
+#define SWEEP_ROB   0
+#define SWEEP_RS    1
+#define SWEEP_BTB   2
+#define SWEEP_PT    3
+#define SWEEP_PREDICTOR 4
+#define SWEEP_PARAMS 5
+
+typedef struct SweepResult
+{
+    int status;
+    int cycles;
+    int instructions;
+    int stalled;
+    int branches;
+    int mispredicts;
+    double host_ns;
+} SweepResult;
+
+typedef struct SweepWorker
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int next;               // next point to run
+    int end;                // one past the last point owned
+    int id;
+    struct Sweep *sweep;
+} SweepWorker;
+
+typedef struct Sweep
+{
+    SharedProgram *programs;
+    int program_count;
+    int *values[SWEEP_PARAMS];
+    int counts[SWEEP_PARAMS];
+    CPUConfig base;         // parameters that are not swept
+    char *memory_file;
+    long max_cycles;
+    int point_count;
+    SweepResult *results;
+    SweepWorker *workers;
+    int threads;
+} Sweep;
+
+static struct option sweep_options[] = {
+    {"rob", required_argument, NULL, 'R'},
+    {"rs", required_argument, NULL, 'S'},
+    {"btb", required_argument, NULL, 'T'},
+    {"pt", required_argument, NULL, 'P'},
+    {"predictor", required_argument, NULL, 'D'},
+    {"config", required_argument, NULL, 'C'},
+    {"memory", required_argument, NULL, 'm'},
+    {"max-cycles", required_argument, NULL, 'n'},
+    {"threads", required_argument, NULL, 'j'},
+    {"output", required_argument, NULL, 'o'},
+    {"json", no_argument, NULL, 'J'},
+    {NULL, 0, NULL, 0}};
+
+// "8", "4:64" (doubling), "2:10:2" (step) or a comma separated list of those
+int parse_size_list(const char *text, int **values, int *count)
+{
+    const char *p = text;
+    int capacity = 16;
+
+    *count = 0;
+    *values = malloc(sizeof(int) * capacity);
+    if (!*values)
+    {
+        return -1;
+    }
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        long step = 0;
+
+        if (end == p || first < 1)
+        {
+            break;
+        }
+        p = end;
+        if (*p == ':')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+            {
+                break;
+            }
+            p = end;
+            if (*p == ':')
+            {
+                step = strtol(p + 1, &end, 10);
+                if (end == p + 1 || step < 1)
+                {
+                    break;
+                }
+                p = end;
+            }
+        }
+        for (long v = first; v <= last; v = step ? v + step : v * 2)
+        {
+            if (*count == capacity)
+            {
+                int *grown = realloc(*values, sizeof(int) * capacity * 2);
+                if (!grown)
+                {
+                    return -1;
+                }
+                *values = grown;
+                capacity *= 2;
+            }
+            (*values)[(*count)++] = (int)v;
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p)
+        {
+            break;
+        }
+    }
+    if (*p || *count == 0)
+    {
+        fprintf(stderr, "Error: invalid size list '%s'\n", text);
+        free(*values);
+        *values = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// comma separated predictor names, e.g. "bimodal,gshare,TAGE"
+static int parse_predictor_list(const char *text, int **values, int *count)
+{
+    const char *p = text;
+
+    *count = 0;
+    *values = malloc(sizeof(int) * (strlen(text) / 2 + 1));
+    if (!*values)
+    {
+        return -1;
+    }
+    for (;;)
+    {
+        int length = (int)strcspn(p, ",");
+        int type = predictor_parse(p, length);
+        if (type < 0)
+        {
+            fprintf(stderr, "Error: invalid predictor list '%s'\n", text);
+            free(*values);
+            *values = NULL;
+            return -1;
+        }
+        (*values)[(*count)++] = type;
+        if (!p[length])
+        {
+            return 0;
+        }
+        p += length + 1;
+    }
+}
+
+// parameters of point, returns its program
+static int point_config(Sweep *sweep, int point, CPUConfig *config)
+{
+    int index[SWEEP_PARAMS];
+
+    *config = sweep->base;
+    for (int i = SWEEP_PARAMS - 1; i >= 0; i--)
+    {
+        index[i] = point % sweep->counts[i];
+        point /= sweep->counts[i];
+    }
+    config->rob_size = sweep->values[SWEEP_ROB][index[SWEEP_ROB]];
+    config->rs_size = sweep->values[SWEEP_RS][index[SWEEP_RS]];
+    config->btb_size = sweep->values[SWEEP_BTB][index[SWEEP_BTB]];
+    config->pt_size = sweep->values[SWEEP_PT][index[SWEEP_PT]];
+    config->predictor = sweep->values[SWEEP_PREDICTOR][index[SWEEP_PREDICTOR]];
+    return point;
+}
+
+static void run_point(Sweep *sweep, int point)
+{
+    SweepResult *result = &sweep->results[point];
+    CPU *cpu = CPU_init();
+
+    if (!cpu)
+    {
+        result->status = 1;
+        return;
+    }
+    int program = point_config(sweep, point, &cpu->config);
+    cpu->trace->level = TRACE_OFF;
+    cpu->memory_file = sweep->memory_file;
+    cpu->max_cycles = sweep->max_cycles;
+    shared_program_attach(cpu, &sweep->programs[program]);
+
+    result->status = CPU_run(cpu, sweep->programs[program].filename);
+    result->cycles = cpu->clockCycle;
+    result->instructions = cpu->simulation_count;
+    result->stalled = cpu->stalled_cycles;
+    result->branches = cpu->branches;
+    result->mispredicts = cpu->mispredicts;
+    result->host_ns = cpu->host_ns;
+    CPU_stop(cpu);
+}
+
+// next point of worker's own range, -1 when it is empty
+static int take_point(SweepWorker *worker)
+{
+    int point = -1;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->next < worker->end)
+    {
+        point = worker->next++;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return point;
+}
+
+// move the upper half of some other worker's range to worker
+static int steal_points(SweepWorker *worker)
+{
+    Sweep *sweep = worker->sweep;
+
+    for (int i = 1; i < sweep->threads; i++)
+    {
+        SweepWorker *victim = &sweep->workers[(worker->id + i) % sweep->threads];
+        int lo;
+        int hi;
+
+        pthread_mutex_lock(&victim->lock);
+        hi = victim->end;
+        lo = victim->next + (victim->end - victim->next) / 2;
+        victim->end = lo;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (lo < hi)
+        {
+            pthread_mutex_lock(&worker->lock);
+            worker->next = lo;
+            worker->end = hi;
+            pthread_mutex_unlock(&worker->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *sweep_worker(void *arg)
+{
+    SweepWorker *worker = arg;
+    int point;
+
+    do
+    {
+        while ((point = take_point(worker)) >= 0)
+        {
+            run_point(worker->sweep, point);
+        }
+    } while (steal_points(worker));
+    return NULL;
+}
+
+static void run_points(Sweep *sweep)
+{
+    int per_worker = sweep->point_count / sweep->threads;
+    int extra = sweep->point_count % sweep->threads;
+    int next = 0;
+
+    for (int i = 0; i < sweep->threads; i++)
+    {
+        SweepWorker *worker = &sweep->workers[i];
+        worker->id = i;
+        worker->sweep = sweep;
+        worker->next = next;
+        next += per_worker + (i < extra);
+        worker->end = next;
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+    for (int i = 0; i < sweep->threads; i++)
+    {
+        pthread_create(&sweep->workers[i].thread, NULL, sweep_worker, &sweep->workers[i]);
+    }
+    for (int i = 0; i < sweep->threads; i++)
+    {
+        pthread_join(sweep->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < sweep->threads; i++)
+    {
+        pthread_mutex_destroy(&sweep->workers[i].lock);
+    }
+}
+
+// a quoted JSON string, or a CSV field quoted only when it needs to be
+static void write_string(FILE *fp, const char *s, int json)
+{
+    if (!json && !strpbrk(s, ",\"\r\n"))
+    {
+        fputs(s, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (; *s; s++)
+    {
+        if (json && (*s == '"' || *s == '\\'))
+        {
+            fprintf(fp, "\\%c", *s);
+        }
+        else if (json && (unsigned char)*s < 0x20)
+        {
+            fprintf(fp, "\\u%04x", *s);
+        }
+        else if (*s == '"')
+        {
+            fputs("\"\"", fp);
+        }
+        else
+        {
+            fputc(*s, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void write_results(Sweep *sweep, FILE *fp, int json)
+{
+    if (json)
+    {
+        fprintf(fp, "[\n");
+    }
+    else
+    {
+        fprintf(fp, "program,rob,rs,btb,pt,predictor,status,cycles,instructions,ipc,stalled,branches,mispredicts,"
+                    "host_ms\n");
+    }
+    for (int point = 0; point < sweep->point_count; point++)
+    {
+        SweepResult *r = &sweep->results[point];
+        CPUConfig config;
+        int program = point_config(sweep, point, &config);
+        const char *name = sweep->programs[program].filename;
+        double ipc = r->cycles ? (double)r->instructions / r->cycles : 0.0;
+
+        if (json)
+        {
+            fprintf(fp, "  {\"program\": ");
+            write_string(fp, name, json);
+            fprintf(fp,
+                    ", \"rob\": %d, \"rs\": %d, \"btb\": %d, \"pt\": %d, \"predictor\": \"%s\", "
+                    "\"status\": \"%s\", \"cycles\": %d, \"instructions\": %d, \"ipc\": %.6f, \"stalled\": %d, "
+                    "\"branches\": %d, \"mispredicts\": %d, \"host_ms\": %.3f}%s\n",
+                    config.rob_size, config.rs_size, config.btb_size, config.pt_size,
+                    predictor_name(config.predictor), r->status ? "failed" : "ok", r->cycles, r->instructions, ipc,
+                    r->stalled, r->branches, r->mispredicts, r->host_ns / 1e6,
+                    point + 1 < sweep->point_count ? "," : "");
+        }
+        else
+        {
+            write_string(fp, name, json);
+            fprintf(fp, ",%d,%d,%d,%d,%s,%s,%d,%d,%.6f,%d,%d,%d,%.3f\n", config.rob_size, config.rs_size,
+                    config.btb_size, config.pt_size, predictor_name(config.predictor), r->status ? "failed" : "ok",
+                    r->cycles, r->instructions, ipc, r->stalled, r->branches, r->mispredicts, r->host_ns / 1e6);
+        }
+    }
+    if (json)
+    {
+        fprintf(fp, "]\n");
+    }
+}
+
+static void free_sweep(Sweep *sweep)
+{
+    for (int i = 0; i < sweep->program_count; i++)
+    {
+        shared_program_close(&sweep->programs[i]);
+    }
+    for (int i = 0; i < SWEEP_PARAMS; i++)
+    {
+        free(sweep->values[i]);
+    }
+    free(sweep->programs);
+    free(sweep->results);
+    free(sweep->workers);
+}
+
+// sim --sweep [options] program...
+int run_sweep(int argc, char **argv)
+{
+    Sweep sweep;
+    char *output = NULL;
+    int json = FALSE;
+    int status = 0;
+    int opt;
+    FILE *fp = stdout;
+
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.memory_file = "memory_map.txt";
+    config_defaults(&sweep.base);
+
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, "m:n:j:o:", sweep_options, NULL)) != -1)
+    {
+        int param = -1;
+        switch (opt)
+        {
+        case 'R':
+            param = SWEEP_ROB;
+            break;
+        case 'S':
+            param = SWEEP_RS;
+            break;
+        case 'T':
+            param = SWEEP_BTB;
+            break;
+        case 'P':
+            param = SWEEP_PT;
+            break;
+        case 'D':
+            free(sweep.values[SWEEP_PREDICTOR]);
+            if (parse_predictor_list(optarg, &sweep.values[SWEEP_PREDICTOR], &sweep.counts[SWEEP_PREDICTOR]))
+            {
+                free_sweep(&sweep);
+                return -1;
+            }
+            break;
+        case 'C':
+            if (config_load(&sweep.base, optarg))
+            {
+                free_sweep(&sweep);
+                return -1;
+            }
+            break;
+        case 'm':
+            sweep.memory_file = optarg;
+            break;
+        case 'n':
+            sweep.max_cycles = atol(optarg);
+            break;
+        case 'j':
+            sweep.threads = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'J':
+            json = TRUE;
+            break;
+        default:
+            free_sweep(&sweep);
+            return -1;
+        }
+        if (param >= 0)
+        {
+            free(sweep.values[param]);
+            if (parse_size_list(optarg, &sweep.values[param], &sweep.counts[param]))
+            {
+                free_sweep(&sweep);
+                return -1;
+            }
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Error : missing program file\n");
+        free_sweep(&sweep);
+        return -1;
+    }
+
+    // unswept parameters keep the base value
+    int defaults[SWEEP_PARAMS] = {sweep.base.rob_size, sweep.base.rs_size, sweep.base.btb_size, sweep.base.pt_size,
+                                  sweep.base.predictor};
+    sweep.point_count = argc - optind;
+    for (int i = 0; i < SWEEP_PARAMS; i++)
+    {
+        if (!sweep.values[i])
+        {
+            sweep.values[i] = malloc(sizeof(int));
+            if (!sweep.values[i])
+            {
+                free_sweep(&sweep);
+                return -1;
+            }
+            sweep.values[i][0] = defaults[i];
+            sweep.counts[i] = 1;
+        }
+        sweep.point_count *= sweep.counts[i];
+    }
+
+    // decode every program once before any worker starts
+    sweep.programs = calloc(argc - optind, sizeof(SharedProgram));
+    sweep.results = calloc(sweep.point_count, sizeof(SweepResult));
+    if (!sweep.programs || !sweep.results)
+    {
+        free_sweep(&sweep);
+        return -1;
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        if (shared_program_open(argv[i], &sweep.programs[sweep.program_count]))
+        {
+            free_sweep(&sweep);
+            return -1;
+        }
+        sweep.program_count++;
+    }
+
+    if (sweep.threads <= 0)
+    {
+        sweep.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (sweep.threads > sweep.point_count)
+    {
+        sweep.threads = sweep.point_count;
+    }
+    sweep.workers = calloc(sweep.threads, sizeof(SweepWorker));
+    if (!sweep.workers)
+    {
+        free_sweep(&sweep);
+        return -1;
+    }
+    fprintf(stderr, "Sweeping %d points on %d threads\n", sweep.point_count, sweep.threads);
+    run_points(&sweep);
+
+    if (output && !(fp = fopen(output, "w")))
+    {
+        fprintf(stderr, "Error opening output file: %s\n", output);
+        free_sweep(&sweep);
+        return -1;
+    }
+    write_results(&sweep, fp, json);
+    if (fp != stdout && fclose(fp))
+    {
+        fprintf(stderr, "Error writing output file: %s\n", output);
+        status = -1;
+    }
+    for (int i = 0; i < sweep.point_count; i++)
+    {
+        status |= sweep.results[i].status != 0;
+    }
+
+    free_sweep(&sweep);
+    return status;
+}
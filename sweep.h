@@ -0,0 +1,14 @@
+/*
+ * Description: Design-space sweeps. Runs every combination of ROB, RS, BTB
+ *              and PT sizes for a list of programs on all host cores and
+ *              writes one CSV or JSON table of the results.
+ */
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+int parse_size_list(const char *text, int **values, int *count);
+
+int run_sweep(int argc, char **argv);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Description: Trace configuration, the binary event ring and its reader.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "cpu.h"
+#include "trace.h"
+
+extern char *instructions[];
+
+static const char *category_names[] = {"fetch", "rs", "exec", "rob", "pred", "regs"};
+
+static const char *event_names[] = {"fetch", "dispatch", "issue", "writeback", "retire", "branch", "mispredict", "replay"};
+
+// stdout buffer used while per-cycle text tracing is on
+static char stdout_buffer[1 << 20];
+
+Trace *trace_create()
+{
+    Trace *trace = calloc(1, sizeof(*trace));
+    if (!trace)
+    {
+        return NULL;
+    }
+    trace->level = TRACE_FULL;
+    trace->categories = TRACE_ALL;
+    trace->start_cycle = 0;
+    trace->end_cycle = LONG_MAX;
+    return trace;
+}
+
+int trace_open_binary(Trace *trace, char *filename, int ring_records)
+{
+    TraceHeader header;
+
+    trace->binary = fopen(filename, "wb");
+    if (!trace->binary)
+    {
+        printf("Error opening trace file: %s\n", filename);
+        return -1;
+    }
+    trace->ring_size = ring_records > 0 ? ring_records : TRACE_RING_RECORDS;
+    trace->ring = malloc(sizeof(TraceRecord) * trace->ring_size);
+    if (!trace->ring)
+    {
+        fclose(trace->binary);
+        trace->binary = NULL;
+        return -1;
+    }
+    // the ring is written in whole chunks, stdio buffering would only copy it again
+    setvbuf(trace->binary, NULL, _IONBF, 0);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, trace->binary);
+    return 0;
+}
+
+// apply the configuration before the first cycle
+void trace_start(Trace *trace)
+{
+    trace->event_mask = trace->binary ? trace->categories : 0;
+}
+
+// single runs only, before anything is written to stdout: setvbuf must be
+// the first operation on the stream and there is one buffer for the process
+void trace_buffer_stdout(Trace *trace)
+{
+    if (TRACE_MAX_LEVEL >= TRACE_STAGE && trace->level >= TRACE_STAGE)
+    {
+        setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+    }
+}
+
+static void trace_flush_ring(Trace *trace)
+{
+    if (trace->ring_count)
+    {
+        fwrite(trace->ring, sizeof(TraceRecord), trace->ring_count, trace->binary);
+        trace->ring_count = 0;
+    }
+}
+
+void trace_event(Trace *trace, unsigned int category, int event, long cycle, int opcode, int pc, int value)
+{
+    TraceRecord *record;
+
+    if (trace->ring_count == trace->ring_size)
+    {
+        trace_flush_ring(trace);
+    }
+    record = &trace->ring[trace->ring_count++];
+    record->cycle = (uint32_t)cycle;
+    record->category = (uint8_t)__builtin_ctz(category);
+    record->event = (uint8_t)event;
+    record->opcode = (uint16_t)opcode;
+    record->pc = pc;
+    record->value = value;
+    trace->records++;
+}
+
+void trace_close(Trace *trace)
+{
+    if (trace->binary)
+    {
+        trace_flush_ring(trace);
+        fclose(trace->binary);
+    }
+    fflush(stdout);
+    free(trace->ring);
+    free(trace);
+}
+
+// off, summary, stage, full or 0-3
+int trace_parse_level(const char *text, int *level)
+{
+    static const char *names[] = {"off", "summary", "stage", "full"};
+
+    for (int i = 0; i < ARRLEN(names); i++)
+    {
+        if (strcmp(text, names[i]) == 0 || (text[0] == '0' + i && text[1] == '\0'))
+        {
+            *level = i;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown trace level: %s (off, summary, stage, full)\n", text);
+    return -1;
+}
+
+// comma separated list of category names, or "all"
+int trace_parse_categories(const char *text, unsigned int *categories)
+{
+    char list[128];
+    char *saveptr;
+
+    snprintf(list, sizeof(list), "%s", text);
+    *categories = 0;
+    for (char *name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr))
+    {
+        int found = FALSE;
+        if (strcmp(name, "all") == 0)
+        {
+            *categories = TRACE_ALL;
+            continue;
+        }
+        for (int i = 0; i < ARRLEN(category_names); i++)
+        {
+            if (strcmp(name, category_names[i]) == 0)
+            {
+                *categories |= 1u << i;
+                found = TRUE;
+            }
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Unknown trace category: %s (fetch, rs, exec, rob, pred, regs, all)\n", name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// START:END, START: or :END, cycles are counted from 1 as printed
+int trace_parse_window(const char *text, long *start, long *end)
+{
+    const char *colon = strchr(text, ':');
+    char *stop;
+
+    if (!colon)
+    {
+        fprintf(stderr, "Trace window must be START:END\n");
+        return -1;
+    }
+    *start = colon == text ? 1 : strtol(text, &stop, 10);
+    *end = colon[1] == '\0' ? LONG_MAX : strtol(colon + 1, &stop, 10);
+    if (*start < 1 || *end < *start)
+    {
+        fprintf(stderr, "Invalid trace window: %s\n", text);
+        return -1;
+    }
+    // internal cycle numbers start at 0
+    (*start)--;
+    if (*end != LONG_MAX)
+    {
+        (*end)--;
+    }
+    return 0;
+}
+
+// print a binary trace as text
+int trace_print_binary(char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    TraceHeader header;
+    TraceRecord record;
+
+    if (!fp)
+    {
+        printf("Error opening trace file: %s\n", filename);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) != 0 ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord))
+    {
+        fprintf(stderr, "%s: error: not a version %d trace\n", filename, TRACE_VERSION);
+        fclose(fp);
+        return 1;
+    }
+    while (fread(&record, sizeof(record), 1, fp) == 1)
+    {
+        printf("%8u %-5s %-10s %04d %-4s %d\n", record.cycle + 1,
+               record.category < ARRLEN(category_names) ? category_names[record.category] : "?",
+               record.event < ARRLEN(event_names) ? event_names[record.event] : "?",
+               record.pc * 4, record.opcode <= RET ? instructions[record.opcode] : "?", record.value);
+    }
+    fclose(fp);
+    return 0;
+}
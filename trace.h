@@ -0,0 +1,114 @@
+/*
+ * Description: Leveled trace output. Text tracing is filtered by level,
+ *              category and cycle window; pipeline events can also go to a
+ *              compact binary log written through a large ring buffer.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <stdint.h>
+#include <stdio.h>
+
+// levels
+#define TRACE_OFF       0   // nothing but the final statistics
+#define TRACE_SUMMARY   1   // final register file
+#define TRACE_STAGE     2   // per-cycle stage occupancy
+#define TRACE_FULL      3   // per-cycle register, ROB, RS and predictor state
+
+// highest level compiled in, build with -DTRACE_MAX_LEVEL=0 for a silent core
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL TRACE_FULL
+#endif
+
+// categories
+#define TRACE_FETCH     (1u << 0)   // IF, ID, IA
+#define TRACE_RS        (1u << 1)   // RR, IS and reservation stations
+#define TRACE_EXEC      (1u << 2)   // functional units
+#define TRACE_ROB       (1u << 3)   // WB, RE and reorder buffer
+#define TRACE_PREDICTOR (1u << 4)   // branch predictor
+#define TRACE_REGS      (1u << 5)   // register file
+#define TRACE_ALL       0x3Fu
+
+// binary events
+#define TRACE_EV_FETCH      0
+#define TRACE_EV_DISPATCH   1
+#define TRACE_EV_ISSUE      2
+#define TRACE_EV_WRITEBACK  3
+#define TRACE_EV_RETIRE     4
+#define TRACE_EV_BRANCH     5
+#define TRACE_EV_MISPREDICT 6
+#define TRACE_EV_REPLAY     7   // load squashed for a memory-order violation
+
+#define TRACE_MAGIC "STRC"
+#define TRACE_VERSION 1
+
+#define TRACE_RING_RECORDS (1 << 20)
+
+typedef struct TraceRecord
+{
+    uint32_t cycle;
+    uint8_t category;
+    uint8_t event;
+    uint16_t opcode;
+    int32_t pc;
+    int32_t value;      // event specific: ROB id, result or branch target
+} TraceRecord;
+
+typedef struct TraceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+} TraceHeader;
+
+typedef struct Trace
+{
+    int level;
+    unsigned int categories;
+    long start_cycle;           // trace window, inclusive
+    long end_cycle;
+    unsigned int event_mask;    // categories logged to the binary trace
+    FILE *binary;
+    TraceRecord *ring;
+    int ring_size;
+    int ring_count;
+    long records;
+} Trace;
+
+#define TRACE_IN_WINDOW(t, cycle) ((cycle) >= (t)->start_cycle && (cycle) <= (t)->end_cycle)
+
+// true when text at lvl for cat should be printed this cycle
+#define TRACE_ON(t, lvl, cat, cycle) \
+    ((lvl) <= TRACE_MAX_LEVEL && (t)->level >= (lvl) && ((t)->categories & (cat)) && TRACE_IN_WINDOW(t, cycle))
+
+// log a binary event, costs one test when the binary trace is off
+#define TRACE_EVENT(t, cat, ev, cycle, op, pc, value)                            \
+    do                                                                           \
+    {                                                                            \
+        if (TRACE_MAX_LEVEL >= TRACE_STAGE && ((t)->event_mask & (cat)) &&       \
+            TRACE_IN_WINDOW(t, cycle))                                           \
+            trace_event(t, cat, ev, cycle, op, pc, value);                       \
+    } while (0)
+
+Trace *trace_create();
+
+int trace_open_binary(Trace *trace, char *filename, int ring_records);
+
+void trace_start(Trace *trace);
+
+void trace_buffer_stdout(Trace *trace);
+
+void trace_event(Trace *trace, unsigned int category, int event, long cycle, int opcode, int pc, int value);
+
+void trace_close(Trace *trace);
+
+int trace_parse_level(const char *text, int *level);
+
+int trace_parse_categories(const char *text, unsigned int *categories);
+
+int trace_parse_window(const char *text, long *start, long *end);
+
+int trace_print_binary(char *filename);
+
+#endif